@@ -2,6 +2,7 @@
 #define _MAT_TEMPLATE_H
 
 #include <cstring>
+#include <utility>
 
 #include "vec.h"
 
@@ -138,6 +139,56 @@ namespace Math
 
 			return res;
 		}
+
+		Mat Inverse() const
+		{
+			double src[Dim][Dim];
+			Mat res(1.0);
+
+			memcpy(src, Data, sizeof(src));
+
+			for (int col = 0; col < Dim; ++col) {
+				int pivot = col;
+
+				for (int row = col + 1; row < Dim; ++row) {
+					double value = fabs(src[row][col]);
+
+					if (value > fabs(src[pivot][col])) {
+						pivot = row;
+					}
+				}
+
+				if (pivot != col) {
+					std::swap(src[col], src[pivot]);
+					std::swap(
+						res.Data[col],
+						res.Data[pivot]);
+				}
+
+				double coeff = 1.0 / src[col][col];
+
+				for (int i = 0; i < Dim; ++i) {
+					src[col][i] *= coeff;
+					res.Data[col][i] *= coeff;
+				}
+
+				for (int row = 0; row < Dim; ++row) {
+					if (row == col) {
+						continue;
+					}
+
+					double f = src[row][col];
+
+					for (int i = 0; i < Dim; ++i) {
+						src[row][i] -= src[col][i] * f;
+						res.Data[row][i] -=
+							res.Data[col][i] * f;
+					}
+				}
+			}
+
+			return res;
+		}
 	};
 }
 
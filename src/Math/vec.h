@@ -7,42 +7,38 @@
 
 namespace Math
 {
-	template<int Dim>
+	template<int Dim, typename T = double>
 	struct Vec
 	{
-		double Data[Dim];
+		T Data[Dim];
 
 		Vec()
 		{ }
 
-		Vec(double* values)
+		Vec(const T* values)
 		{
 			for (int i = 0; i < Dim; ++i) {
 				Data[i] = values[i];
 			}
 		}
 
-		Vec(double value)
+		Vec(T value)
 		{
 			for (int i = 0; i < Dim; ++i) {
 				Data[i] = value;
 			}
 		}
 
-		Vec(const Vec<Dim - 1>& vec, double value)
+		Vec(const Vec<Dim - 1, T>& vec, T value)
 		{
-			memcpy(Data, vec.Data, sizeof(double) * (Dim - 1));
+			memcpy(Data, vec.Data, sizeof(T) * (Dim - 1));
 			Data[Dim - 1] = value;
 		}
 
-		template<int N>
-		Vec(const Vec<N>& vec)
+		template<int N, typename U>
+		Vec(const Vec<N, U>& vec)
 		{
-			if (N < Dim) {
-				memcpy(Data, vec.Data, sizeof(vec.Data));
-			} else {
-				memcpy(Data, vec.Data, sizeof(Data));
-			}
+			Assign(vec);
 		}
 
 		Vec(std::initializer_list<double> l)
@@ -55,29 +51,24 @@ namespace Math
 			}
 		}
 
-		double& operator[](int index)
+		T& operator[](int index)
 		{
 			return Data[index];
 		}
 
-		double operator[](int index) const
+		T operator[](int index) const
 		{
 			return Data[index];
 		}
 
-		template<int N>
-		Vec& operator=(const Vec<N>& vec)
+		template<int N, typename U>
+		Vec& operator=(const Vec<N, U>& vec)
 		{
-			if (N < Dim) {
-				memcpy(Data, vec.Data, sizeof(vec.Data));
-			} else {
-				memcpy(Data, vec.Data, sizeof(Data));
-			}
-
+			Assign(vec);
 			return *this;
 		}
 
-		Vec& operator=(double* values)
+		Vec& operator=(const T* values)
 		{
 			for (int i = 0; i < Dim; ++i) {
 				Data[i] = values[i];
@@ -86,7 +77,7 @@ namespace Math
 			return *this;
 		}
 
-		Vec& operator=(double value)
+		Vec& operator=(T value)
 		{
 			for (int i = 0; i < Dim; ++i) {
 				Data[i] = value;
@@ -142,7 +133,7 @@ namespace Math
 			}
 		}
 
-		Vec operator*(double value) const
+		Vec operator*(T value) const
 		{
 			Vec res;
 
@@ -153,7 +144,7 @@ namespace Math
 			return res;
 		}
 
-		Vec operator/(double value) const
+		Vec operator/(T value) const
 		{
 			Vec res;
 
@@ -164,23 +155,23 @@ namespace Math
 			return res;
 		}
 
-		void operator*=(double value)
+		void operator*=(T value)
 		{
 			for (int i = 0; i < Dim; ++i) {
 				Data[i] *= value;
 			}
 		}
 
-		void operator/=(double value)
+		void operator/=(T value)
 		{
 			for (int i = 0; i < Dim; ++i) {
 				Data[i] /= value;
 			}
 		}
 
-		double Length() const
+		T Length() const
 		{
-			double sum = 0;
+			T sum = 0;
 
 			for (int i = 0; i < Dim; ++i) {
 				sum += pow(Data[i], 2);
@@ -189,9 +180,9 @@ namespace Math
 			return sqrt(sum);
 		}
 
-		double Dot(const Vec& vec) const
+		T Dot(const Vec& vec) const
 		{
-			double sum = 0;
+			T sum = 0;
 
 			for (int i = 0; i < Dim; ++i) {
 				sum += Data[i] * vec.Data[i];
@@ -200,9 +191,9 @@ namespace Math
 			return sum;
 		}
 
-		Vec<3> Cross(const Vec<3>& vec) const
+		Vec<3, T> Cross(const Vec<3, T>& vec) const
 		{
-			Vec<3> res;
+			Vec<3, T> res;
 			res[0] = Data[1] * vec.Data[2] - Data[2] * vec.Data[1],
 			res[1] = Data[2] * vec.Data[0] - Data[0] * vec.Data[2],
 			res[2] = Data[0] * vec.Data[1] - Data[1] * vec.Data[0];
@@ -220,6 +211,17 @@ namespace Math
 			Vec normVec = vec.Normalize();
 			return normVec * Dot(normVec);
 		}
+
+	private:
+		template<int N, typename U>
+		void Assign(const Vec<N, U>& vec)
+		{
+			const int count = N < Dim ? N : Dim;
+
+			for (int i = 0; i < count; ++i) {
+				Data[i] = vec.Data[i];
+			}
+		}
 	};
 }
 
@@ -0,0 +1,123 @@
+#ifndef _BENCHMARK_SCENE_H
+#define _BENCHMARK_SCENE_H
+
+#include <cmath>
+#include <chrono>
+
+#include "../../Math/transform.h"
+#include "../PhysicalObject.h"
+#include "../SoftObject.h"
+
+// Scene pieces shared by the physics benchmarks. All of them are
+// deterministic, so runs can be compared across builds.
+
+// Square mesh of cells x cells quads centered on the origin, with
+// gentle hills of height amplitude.
+inline void CreateTerrain(
+	PhysicalObject& object,
+	uint32_t cells,
+	double size,
+	double amplitude)
+{
+	auto& params = object.PhysicalParams;
+
+	for (uint32_t y = 0; y <= cells; ++y) {
+		for (uint32_t x = 0; x <= cells; ++x) {
+			double px = size * ((double)x / cells - 0.5);
+			double py = size * ((double)y / cells - 0.5);
+			double pz = amplitude * sin(px) * cos(py);
+
+			params.Vertices.push_back(Math::Vec<3>({px, py, pz}));
+			params.Normals.push_back(Math::Vec<3>({0, 0, 1}));
+		}
+	}
+
+	for (uint32_t y = 0; y < cells; ++y) {
+		for (uint32_t x = 0; x < cells; ++x) {
+			uint32_t corner = y * (cells + 1) + x;
+			uint32_t above = corner + cells + 1;
+
+			params.Indices.insert(
+				params.Indices.end(),
+				{corner, corner + 1, above + 1});
+			params.Indices.insert(
+				params.Indices.end(),
+				{corner, above + 1, above});
+		}
+	}
+
+	params.Matrix = Math::Mat<4>(1.0);
+	params.Enabled = true;
+	params.Mu = 0.5;
+	params.Bounciness = 0.2;
+}
+
+// Horizontal cloth of side x side vertices of 0.1 kg under gravity,
+// with structural and shear links of stiffness k.
+inline void CreateCloth(
+	SoftObject& object,
+	uint32_t side,
+	double size,
+	const Math::Vec<3>& center,
+	double k)
+{
+	auto& params = object.SoftPhysicsParams;
+
+	for (uint32_t y = 0; y < side; ++y) {
+		for (uint32_t x = 0; x < side; ++x) {
+			SoftObject::SoftPhysicsValues::Vertex vertex;
+			vertex.Mass = 0.1;
+			vertex.Mu = 0.5;
+			vertex.Bounciness = 0.1;
+			vertex.Position = center + Math::Vec<3>({
+				size * ((double)x / (side - 1) - 0.5),
+				size * ((double)y / (side - 1) - 0.5),
+				0.01 * x});
+			vertex.Force = Math::Vec<3>({0, 0, -9.8 * 0.1});
+
+			params.Vertices.push_back(vertex);
+		}
+	}
+
+	auto link = [&](size_t first, size_t second) -> void
+	{
+		SoftObject::SoftPhysicsValues::Link link;
+		link.Index1 = first;
+		link.Index2 = second;
+		link.Length = Math::Vec<3>(
+			params.Vertices[first].Position -
+			params.Vertices[second].Position).Length();
+		link.K = k;
+		link.Friction = 0.1;
+
+		params.Links.push_back(link);
+	};
+
+	for (uint32_t y = 0; y < side; ++y) {
+		for (uint32_t x = 0; x < side; ++x) {
+			size_t vertex = y * side + x;
+
+			if (x + 1 < side) {
+				link(vertex, vertex + 1);
+			}
+
+			if (y + 1 < side) {
+				link(vertex, vertex + side);
+			}
+
+			if (x + 1 < side && y + 1 < side) {
+				link(vertex, vertex + side + 1);
+			}
+		}
+	}
+}
+
+inline double GetMilliseconds(
+	std::chrono::high_resolution_clock::time_point start)
+{
+	auto now = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double, std::milli>(now - start).count();
+}
+
+#endif
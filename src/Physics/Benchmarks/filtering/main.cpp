@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <vector>
+
+#include "../BenchmarkScene.h"
+#include "../../PhysicalEngine.h"
+#include "../../../Logger/logger.h"
+
+// Debris cloths falling through foliage spheres onto a terrain, run
+// once with everything colliding and once with debris masking foliage
+// out. Prints the broadphase pairs skipped by the filters and those
+// passed on to collision. Masked debris is only swept against the
+// terrain, so the masked run should be the faster one.
+
+static const uint32_t DebrisCount = 200;
+static const uint32_t FoliageCount = 2000;
+static const uint32_t Ticks = 100;
+
+static const uint32_t TerrainCategory = 1;
+static const uint32_t DebrisCategory = 2;
+static const uint32_t FoliageCategory = 4;
+
+// Deterministic positions spread over the terrain.
+static double Scatter(uint32_t index, uint32_t salt)
+{
+	uint32_t hash = (index + 1) * 2654435761u ^ salt * 40503u;
+	hash ^= hash >> 15;
+	hash *= 2246822519u;
+	hash ^= hash >> 13;
+
+	return (hash % 10000) / 10000.0;
+}
+
+static void Simulate(ThreadPool* threadPool, bool masked)
+{
+	PhysicalEngine engine;
+	PhysicalObject terrain;
+	std::vector<PhysicalObject> foliage(FoliageCount);
+	std::vector<SoftObject> debris(DebrisCount);
+
+	CreateTerrain(terrain, 60, 40, 0.3);
+	terrain.PhysicalParams.Category = TerrainCategory;
+	engine.RegisterObject(&terrain);
+
+	for (uint32_t idx = 0; idx < FoliageCount; ++idx) {
+		auto& params = foliage[idx].PhysicalParams;
+		Math::Vec<3> position({
+			40 * Scatter(idx, 1) - 20,
+			40 * Scatter(idx, 2) - 20,
+			0.5 + 1.5 * Scatter(idx, 3)});
+
+		params.Shape =
+			PhysicalObject::PhysicalValues::ShapeType::Sphere;
+		params.Radius = 0.4;
+		params.Matrix = Math::Translate(position);
+		params.Enabled = true;
+		params.Mu = 0.5;
+		params.Bounciness = 0.2;
+		params.Category = FoliageCategory;
+
+		engine.RegisterObject(&foliage[idx]);
+	}
+
+	for (uint32_t idx = 0; idx < DebrisCount; ++idx) {
+		auto& params = debris[idx].SoftPhysicsParams;
+		Math::Vec<3> center({
+			36 * Scatter(idx, 4) - 18,
+			36 * Scatter(idx, 5) - 18,
+			3 + 2 * Scatter(idx, 6)});
+
+		CreateCloth(debris[idx], 8, 0.8, center, 50);
+		params.Category = DebrisCategory;
+
+		if (masked) {
+			params.Mask = ~FoliageCategory;
+		}
+
+		engine.RegisterObject(&debris[idx]);
+	}
+
+	size_t filteredPairs = 0;
+	size_t collisionPairs = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t tick = 0; tick < Ticks; ++tick) {
+		engine.Run(threadPool, 0.02);
+
+		PhysicalEngine::Statistics statistics =
+			engine.GetStatistics();
+		filteredPairs += statistics.FilteredPairs;
+		collisionPairs += statistics.CollisionPairs;
+	}
+
+	printf(
+		"%-9s filtered pairs %8zu, collision pairs %8zu, "
+		"%.2f ms per tick\n",
+		masked ? "masked" : "unmasked",
+		filteredPairs,
+		collisionPairs,
+		GetMilliseconds(start) / Ticks);
+}
+
+int main()
+{
+	Logger::SetLevel(Logger::Level::Error);
+
+	ThreadPool threadPool;
+
+	printf(
+		"%u debris cloths, %u foliage spheres, %u ticks\n",
+		DebrisCount,
+		FoliageCount,
+		Ticks);
+
+	Simulate(&threadPool, false);
+	Simulate(&threadPool, true);
+
+	return 0;
+}
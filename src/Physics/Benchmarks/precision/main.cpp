@@ -0,0 +1,239 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+#include "../BenchmarkScene.h"
+#include "../../PhysicalEngine.h"
+#include "../../../Logger/logger.h"
+
+// Compares soft vertex trajectories of a float build against those of
+// a double build. The double build writes its positions after every
+// tick, the float build runs the same scene and measures how far its
+// vertices end up from them:
+//   precision_double write trajectory.bin [ticks]
+//   precision_float compare trajectory.bin
+// Contacts and friction are not continuous, so once the cloths land
+// their vertices settle into slightly different folds in the two
+// builds. compare therefore checks that the cloth centroids stay
+// within CentroidTolerance and that the RMS deviation over all
+// vertices stays within RmsTolerance, bounded instead of growing.
+
+static const double CentroidTolerance = 0.05;
+static const double RmsTolerance = 0.2;
+static const double TimeStep = 0.02;
+
+class Scene
+{
+public:
+	Scene()
+	{
+		CreateTerrain(_terrain, 120, 20, 0.3);
+		CreateTerrain(_platform, 4, 2, 0);
+		_platform.PhysicalParams.Dynamic = true;
+
+		_engine.SetDeterministic(true);
+		_engine.RegisterObject(&_terrain);
+		_engine.RegisterObject(&_platform);
+
+		// Soft and stiff force integrated cloths and an XPBD one.
+		CreateCloth(_cloths[0], 16, 2, Math::Vec<3>({-4, 0, 1.5}), 50);
+		CreateCloth(_cloths[1], 16, 2, Math::Vec<3>({0, 0, 1.5}), 5000);
+		CreateCloth(_cloths[2], 24, 3, Math::Vec<3>({5, 0, 2.5}), 1e5);
+		_cloths[2].SoftPhysicsParams.Solver =
+			SoftObject::SoftPhysicsValues::SolverType::GaussSeidel;
+
+		for (SoftObject& cloth : _cloths) {
+			_engine.RegisterObject(&cloth);
+		}
+	}
+
+	void Run(ThreadPool* threadPool, uint32_t tick)
+	{
+		_platform.PhysicalParams.Matrix =
+			Math::Translate(Math::Vec<3>({5, 0, 0.8})) *
+			Math::Rotate(tick * 0.01, Math::Vec<3>({0, 0, 1}));
+
+		_engine.Run(threadPool, TimeStep);
+	}
+
+	static const uint32_t ClothCount = 3;
+
+	uint32_t GetVertexCount(uint32_t cloth)
+	{
+		return _cloths[cloth].SoftPhysicsParams.Vertices.size();
+	}
+
+	void GetPositions(std::vector<double>& positions)
+	{
+		positions.clear();
+
+		for (SoftObject& cloth : _cloths) {
+			for (auto& position :
+				cloth.SoftPhysicsParams.Vertices.GetPositions())
+			{
+				for (int i = 0; i < 3; ++i) {
+					positions.push_back(position[i]);
+				}
+			}
+		}
+	}
+
+private:
+	PhysicalEngine _engine;
+	PhysicalObject _terrain;
+	PhysicalObject _platform;
+	SoftObject _cloths[ClothCount];
+};
+
+static int Write(const char* fileName, uint32_t ticks)
+{
+	ThreadPool threadPool;
+	Scene scene;
+	std::vector<double> positions;
+
+	std::fstream file;
+	file.open(fileName, std::ios::out | std::ios::binary);
+
+	if (!file.is_open()) {
+		printf("Failed to open %s\n", fileName);
+		return 1;
+	}
+
+	scene.GetPositions(positions);
+
+	uint32_t count = positions.size();
+	file.write((const char*)&ticks, sizeof(ticks));
+	file.write((const char*)&count, sizeof(count));
+
+	for (uint32_t tick = 0; tick < ticks; ++tick) {
+		scene.Run(&threadPool, tick);
+		scene.GetPositions(positions);
+		file.write(
+			(const char*)positions.data(),
+			count * sizeof(double));
+	}
+
+	printf(
+		"Wrote %u ticks of %u vertices with %zu byte scalars\n",
+		ticks,
+		count / 3,
+		sizeof(PhysicsScalar));
+
+	return 0;
+}
+
+static int Compare(const char* fileName)
+{
+	ThreadPool threadPool;
+	Scene scene;
+	std::vector<double> positions;
+	std::vector<double> reference;
+
+	std::fstream file;
+	file.open(fileName, std::ios::in | std::ios::binary);
+
+	if (!file.is_open()) {
+		printf("Failed to open %s\n", fileName);
+		return 1;
+	}
+
+	uint32_t ticks;
+	uint32_t count;
+	file.read((char*)&ticks, sizeof(ticks));
+	file.read((char*)&count, sizeof(count));
+
+	scene.GetPositions(positions);
+
+	if (!file || count != positions.size()) {
+		printf("%s does not match the scene\n", fileName);
+		return 1;
+	}
+
+	reference.resize(count);
+
+	double worstRms = 0;
+	double worstCentroid = 0;
+
+	for (uint32_t tick = 0; tick < ticks; ++tick) {
+		file.read((char*)reference.data(), count * sizeof(double));
+
+		if (!file) {
+			printf("%s ends at tick %u\n", fileName, tick);
+			return 1;
+		}
+
+		scene.Run(&threadPool, tick);
+		scene.GetPositions(positions);
+
+		double sumSq = 0;
+		double centroid = 0;
+		uint32_t idx = 0;
+
+		for (uint32_t cloth = 0; cloth < Scene::ClothCount; ++cloth) {
+			uint32_t vertexCount = scene.GetVertexCount(cloth);
+			uint32_t end = idx + 3 * vertexCount;
+			Math::Vec<3> shift(0.0);
+
+			for (; idx < end; ++idx) {
+				double delta = positions[idx] - reference[idx];
+				sumSq += delta * delta;
+				shift[idx % 3] += delta;
+			}
+
+			centroid = std::max(
+				centroid,
+				shift.Length() / vertexCount);
+		}
+
+		double rms = sqrt(sumSq / (count / 3));
+
+		worstRms = std::max(worstRms, rms);
+		worstCentroid = std::max(worstCentroid, centroid);
+
+		if ((tick + 1) % 50 == 0) {
+			printf(
+				"tick %4u: centroid %.6f rms %.6f\n",
+				tick + 1,
+				centroid,
+				rms);
+		}
+	}
+
+	bool passed =
+		worstCentroid <= CentroidTolerance &&
+		worstRms <= RmsTolerance;
+
+	printf(
+		"%s: worst centroid %.6f (tolerance %.2f), "
+		"worst rms %.6f (tolerance %.2f)\n",
+		passed ? "PASSED" : "FAILED",
+		worstCentroid,
+		CentroidTolerance,
+		worstRms,
+		RmsTolerance);
+
+	return passed ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	Logger::SetLevel(Logger::Level::Error);
+
+	if (argc >= 3 && !strcmp(argv[1], "write")) {
+		uint32_t ticks = argc >= 4 ? atoi(argv[3]) : 500;
+		return Write(argv[2], ticks);
+	}
+
+	if (argc == 3 && !strcmp(argv[1], "compare")) {
+		return Compare(argv[2]);
+	}
+
+	printf(
+		"Usage: %s write <file> [ticks] | compare <file>\n",
+		argv[0]);
+
+	return 1;
+}
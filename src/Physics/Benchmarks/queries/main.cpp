@@ -0,0 +1,215 @@
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "../BenchmarkScene.h"
+#include "../../PhysicalEngine.h"
+#include "../../Primitives.h"
+#include "../../../Logger/logger.h"
+
+// Checks ClosestPoint and OverlapSphere against a brute force search
+// over all world space triangles, on meshes under rotated non-uniform
+// scales: a static one, a dynamic one and one with a shared mesh.
+// Two disabled meshes in their midst, one of them disabled only after
+// the step, must not be found, and a field of spheres away from them
+// should not slow the queries down. Prints the time per query and
+// fails on any mismatch.
+
+static const uint32_t Queries = 20000;
+static const uint32_t SphereCount = 2000;
+static const double MaxDistance = 2;
+static const double Tolerance = 1e-6;
+
+struct Triangle
+{
+	Math::Vec<3> Corners[3];
+};
+
+static double Random(uint32_t& state)
+{
+	state = state * 1664525u + 1013904223u;
+
+	return (state >> 8) / (double)(1 << 24);
+}
+
+static void AddTriangles(
+	const PhysicalObject& object,
+	std::vector<Triangle>& triangles)
+{
+	const auto& params = object.PhysicalParams;
+
+	for (size_t idx = 0; idx < params.Indices.size(); idx += 3) {
+		Triangle triangle;
+
+		for (int i = 0; i < 3; ++i) {
+			const Math::Vec<3>& vertex =
+				params.Vertices[params.Indices[idx + i]];
+			triangle.Corners[i] =
+				params.Matrix * Math::Vec<4>(vertex, 1.0);
+		}
+
+		triangles.push_back(triangle);
+	}
+}
+
+static double GetDistance(
+	const std::vector<Triangle>& triangles,
+	const Math::Vec<3>& point)
+{
+	double distance = INFINITY;
+
+	for (const Triangle& triangle : triangles) {
+		Math::Vec<3> closest = ClosestPointTriangle(
+			triangle.Corners[0],
+			triangle.Corners[1],
+			triangle.Corners[2],
+			point);
+
+		distance = std::min(distance, (closest - point).Length());
+	}
+
+	return distance;
+}
+
+int main()
+{
+	Logger::SetLevel(Logger::Level::Error);
+
+	PhysicalEngine engine;
+	PhysicalObject objects[3];
+	PhysicalObject disabled[2];
+	std::vector<PhysicalObject> spheres(SphereCount);
+	std::vector<Triangle> triangles[3];
+
+	objects[0].PhysicalParams.Matrix =
+		Math::Translate(Math::Vec<3>({-3, 0, 0})) *
+		Math::Rotate(0.7, Math::Vec<3>({1, 0.3, 0.2})) *
+		Math::Scale(Math::Vec<3>({1, 0.1, 2.5}));
+	objects[1].PhysicalParams.Matrix =
+		Math::Rotate(M_PI / 4, Math::Vec<3>({0, 0, 1})) *
+		Math::Scale(Math::Vec<3>({1, 0.1, 1}));
+	objects[2].PhysicalParams.Matrix =
+		Math::Translate(Math::Vec<3>({3, 1, 0})) *
+		Math::Rotate(1.9, Math::Vec<3>({0.2, 1, 1})) *
+		Math::Scale(Math::Vec<3>({3, 0.2, 0.5}));
+
+	for (int idx = 0; idx < 3; ++idx) {
+		Math::Mat<4> matrix = objects[idx].PhysicalParams.Matrix;
+
+		CreateTerrain(objects[idx], 40, 4, 0.5);
+		objects[idx].PhysicalParams.Matrix = matrix;
+		AddTriangles(objects[idx], triangles[idx]);
+	}
+
+	objects[1].PhysicalParams.Dynamic = true;
+
+	auto& shared = objects[2].PhysicalParams;
+	shared.Mesh = CollisionMesh::Create(
+		shared.Vertices,
+		shared.Normals,
+		shared.Indices);
+
+	for (PhysicalObject& object : objects) {
+		engine.RegisterObject(&object);
+	}
+
+	shared.Mesh->DecRef();
+
+	for (int idx = 0; idx < 2; ++idx) {
+		CreateTerrain(disabled[idx], 10, 4, 0.5);
+		disabled[idx].PhysicalParams.Matrix = Math::Translate(
+			Math::Vec<3>({3.0 * idx - 1.5, 0, 0.5}));
+		engine.RegisterObject(&disabled[idx]);
+	}
+
+	disabled[0].PhysicalParams.Enabled = false;
+
+	uint32_t scatter = 2;
+
+	for (uint32_t idx = 0; idx < SphereCount; ++idx) {
+		auto& params = spheres[idx].PhysicalParams;
+		params.Shape =
+			PhysicalObject::PhysicalValues::ShapeType::Sphere;
+		params.Radius = 0.2;
+		params.Matrix = Math::Translate(Math::Vec<3>({
+			20 + 40 * Random(scatter),
+			40 * Random(scatter) - 20,
+			4 * Random(scatter) - 2}));
+		params.Enabled = true;
+
+		engine.RegisterObject(&spheres[idx]);
+	}
+
+	// Applies the registrations.
+	ThreadPool threadPool;
+	engine.Run(&threadPool, 0.01);
+
+	disabled[1].PhysicalParams.Enabled = false;
+
+	uint32_t random = 1;
+	uint32_t closestMismatches = 0;
+	uint32_t overlapMismatches = 0;
+	double closestMs = 0;
+	double overlapMs = 0;
+
+	for (uint32_t query = 0; query < Queries; ++query) {
+		Math::Vec<3> point({
+			12 * Random(random) - 6,
+			8 * Random(random) - 4,
+			8 * Random(random) - 4});
+		double radius = 0.5 * Random(random);
+
+		double distances[3];
+		double nearest = INFINITY;
+
+		for (int idx = 0; idx < 3; ++idx) {
+			distances[idx] = GetDistance(triangles[idx], point);
+			nearest = std::min(nearest, distances[idx]);
+		}
+
+		PhysicalEngine::PointHit hit;
+		auto start = std::chrono::high_resolution_clock::now();
+		engine.ClosestPoint(point, MaxDistance, hit);
+		closestMs += GetMilliseconds(start);
+
+		double error = fabs(hit.Distance - nearest);
+		bool closestMatches = nearest > MaxDistance ?
+			hit.Object == nullptr :
+			hit.Object && error <= Tolerance * (1 + nearest);
+
+		if (!closestMatches) {
+			++closestMismatches;
+		}
+
+		PhysicalObject* found[3];
+		start = std::chrono::high_resolution_clock::now();
+		size_t count = engine.OverlapSphere(point, radius, found, 3);
+		overlapMs += GetMilliseconds(start);
+
+		size_t expected = 0;
+		bool ambiguous = false;
+
+		for (int idx = 0; idx < 3; ++idx) {
+			expected += distances[idx] <= radius;
+			ambiguous |= fabs(distances[idx] - radius) <= Tolerance;
+		}
+
+		if (count != expected && !ambiguous) {
+			++overlapMismatches;
+		}
+	}
+
+	printf(
+		"ClosestPoint: %u mismatches of %u, %.2f us per query\n",
+		closestMismatches,
+		Queries,
+		closestMs * 1000 / Queries);
+	printf(
+		"OverlapSphere: %u mismatches of %u, %.2f us per query\n",
+		overlapMismatches,
+		Queries,
+		overlapMs * 1000 / Queries);
+
+	return closestMismatches || overlapMismatches ? 1 : 0;
+}
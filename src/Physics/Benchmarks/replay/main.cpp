@@ -0,0 +1,153 @@
+#include <cstdio>
+#include <vector>
+
+#include "../BenchmarkScene.h"
+#include "../../PhysicalEngine.h"
+#include "../../PhysicsRecorder.h"
+#include "../../../Logger/logger.h"
+
+// Records a scene with a rotating dynamic platform and soft forces that
+// change along the way, then replays the recording headless on fresh
+// copies of the scene with one and with several worker threads. Every
+// replayed tick must repeat the recorded checksum. Prints the time
+// spent in the engine per replay.
+
+static const uint32_t ClothCount = 5;
+static const uint32_t ClothSide = 24;
+static const uint32_t Ticks = 150;
+static const uint32_t ReplayThreads = 4;
+static const double TimeStep = 0.02;
+
+class Scene
+{
+public:
+	Scene() : _cloths(ClothCount)
+	{
+		CreateTerrain(_terrain, 120, 30, 0.3);
+		CreateTerrain(_platform, 4, 2, 0);
+		_platform.PhysicalParams.Dynamic = true;
+
+		_engine.RegisterObject(&_terrain);
+		_engine.RegisterObject(&_platform);
+		_objects = {&_terrain, &_platform};
+
+		for (uint32_t idx = 0; idx < ClothCount; ++idx) {
+			Math::Vec<3> center({-10.0 + 5.0 * idx, 0, 1.5});
+
+			CreateCloth(_cloths[idx], ClothSide, 3, center, 50);
+			_engine.RegisterObject(&_cloths[idx]);
+			_softObjects.push_back(&_cloths[idx]);
+		}
+	}
+
+	// Changes the inputs the recorder has to capture.
+	void Prepare(uint32_t tick)
+	{
+		_platform.PhysicalParams.Matrix =
+			Math::Translate(Math::Vec<3>({2.5, 0, 1})) *
+			Math::Rotate(tick * 0.02, Math::Vec<3>({0, 0, 1}));
+
+		if (tick == Ticks / 3) {
+			_cloths[0].SoftPhysicsParams.Force =
+				Math::Vec<3>({0.1, 0, 0});
+		}
+
+		if (tick == Ticks / 2) {
+			auto& vertices = _cloths[1].SoftPhysicsParams.Vertices;
+			vertices.GetForces()[ClothSide / 2] =
+				PhysicsVec3({0, 0, 2});
+		}
+	}
+
+	PhysicalEngine& GetEngine()
+	{
+		return _engine;
+	}
+
+	const std::vector<PhysicalObject*>& GetObjects() const
+	{
+		return _objects;
+	}
+
+	const std::vector<SoftObject*>& GetSoftObjects() const
+	{
+		return _softObjects;
+	}
+
+private:
+	PhysicalEngine _engine;
+	PhysicalObject _terrain;
+	PhysicalObject _platform;
+	std::vector<SoftObject> _cloths;
+	std::vector<PhysicalObject*> _objects;
+	std::vector<SoftObject*> _softObjects;
+};
+
+static bool Replay(const std::vector<uint8_t>& stream, uint32_t threads)
+{
+	ThreadPool threadPool(threads);
+	Scene scene;
+
+	PhysicsRecorder::ReplayResult result = PhysicsRecorder::Replay(
+		stream,
+		&scene.GetEngine(),
+		scene.GetObjects(),
+		scene.GetSoftObjects(),
+		&threadPool);
+
+	bool matches =
+		result.Ticks == Ticks &&
+		result.FirstMismatch == UINT32_MAX;
+
+	if (matches) {
+		printf(
+			"%u threads: %u ticks match, %.2f ms\n",
+			threads,
+			result.Ticks,
+			result.RunSeconds * 1000);
+	} else {
+		printf(
+			"%u threads: %u ticks, first mismatch at %u\n",
+			threads,
+			result.Ticks,
+			result.FirstMismatch);
+	}
+
+	return matches;
+}
+
+int main()
+{
+	Logger::SetLevel(Logger::Level::Error);
+
+	std::vector<uint8_t> stream;
+
+	{
+		ThreadPool threadPool(ReplayThreads);
+		Scene scene;
+		PhysicsRecorder recorder(
+			&scene.GetEngine(),
+			scene.GetObjects(),
+			scene.GetSoftObjects());
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		for (uint32_t tick = 0; tick < Ticks; ++tick) {
+			scene.Prepare(tick);
+			recorder.Run(&threadPool, TimeStep);
+		}
+
+		printf(
+			"recorded %u ticks, %.1f KB, %.2f ms\n",
+			Ticks,
+			recorder.GetStream().size() / 1024.0,
+			GetMilliseconds(start));
+
+		stream = recorder.GetStream();
+	}
+
+	bool single = Replay(stream, 1);
+	bool multiple = Replay(stream, ReplayThreads);
+
+	return single && multiple ? 0 : 1;
+}
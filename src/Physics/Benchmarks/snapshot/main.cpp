@@ -0,0 +1,289 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "../BenchmarkScene.h"
+#include "../../PhysicalEngine.h"
+#include "../../../Logger/logger.h"
+
+// Times saving and restoring a rollback snapshot of 100k soft vertices
+// and checks that a resimulation from it repeats the original ticks
+// exactly in deterministic mode. Then checks that snapshot records
+// follow their objects by handle: restoring still works after another
+// removal reorders the descriptors, and is refused once a recorded
+// object is replaced by a new one of the same size. Last, snapshots are
+// saved and restored while another thread registers objects, whose
+// handle reservations grow the slots the snapshots look up.
+
+static const uint32_t ClothCount = 10;
+static const uint32_t ClothSide = 100;
+static const uint32_t WarmupTicks = 20;
+static const uint32_t ReplayTicks = 30;
+static const uint32_t Repeats = 20;
+static const uint32_t StressObjects = 20000;
+static const double TimeStep = 0.02;
+
+class Scene
+{
+public:
+	Scene() : _cloths(ClothCount), _stressObjects(StressObjects)
+	{
+		CreateTerrain(_terrain, 120, 40, 0.3);
+
+		auto& marker = _marker.PhysicalParams;
+		marker.Shape =
+			PhysicalObject::PhysicalValues::ShapeType::Sphere;
+		marker.Radius = 1;
+		marker.Matrix = Math::Translate(Math::Vec<3>({0, 0, -50}));
+		marker.Enabled = true;
+
+		for (PhysicalObject& platform : _platforms) {
+			CreateTerrain(platform, 4, 2, 0);
+			platform.PhysicalParams.Dynamic = true;
+		}
+
+		_engine.SetDeterministic(true);
+		_engine.RegisterObject(&_terrain);
+		_markerHandle = _engine.RegisterObject(&_marker);
+
+		for (PhysicalObject& platform : _platforms) {
+			_engine.RegisterObject(&platform);
+		}
+
+		for (uint32_t idx = 0; idx < ClothCount; ++idx) {
+			Math::Vec<3> center({
+				-16.0 + 8.0 * (idx % 5),
+				-5.0 + 10.0 * (idx / 5),
+				1.5});
+
+			CreateCloth(_cloths[idx], ClothSide, 6, center, 50);
+			_clothHandles[idx] =
+				_engine.RegisterObject(&_cloths[idx]);
+		}
+	}
+
+	void Run(ThreadPool* threadPool, uint32_t tick)
+	{
+		Math::Vec<3> axis({0, 0, 1});
+
+		for (uint32_t idx = 0; idx < 2; ++idx) {
+			Math::Vec<3> center({-12.0 + 8 * idx, 0, 1});
+
+			_platforms[idx].PhysicalParams.Matrix =
+				Math::Translate(center) *
+				Math::Rotate(tick * 0.02, axis);
+		}
+
+		_engine.Run(threadPool, TimeStep);
+	}
+
+	void GetPositions(std::vector<PhysicsVec3>& positions)
+	{
+		positions.clear();
+
+		for (SoftObject& cloth : _cloths) {
+			auto& column =
+				cloth.SoftPhysicsParams.Vertices.GetPositions();
+			positions.insert(
+				positions.end(),
+				column.data(),
+				column.data() + column.size());
+		}
+	}
+
+	PhysicalEngine& GetEngine()
+	{
+		return _engine;
+	}
+
+	PhysicalObject& GetPlatform(uint32_t index)
+	{
+		return _platforms[index];
+	}
+
+	void RemoveMarker()
+	{
+		_engine.RemoveObject(_markerHandle);
+	}
+
+	// Same vertex count in a new slot generation.
+	void ReplaceFirstCloth()
+	{
+		_engine.RemoveObject(_clothHandles[0]);
+
+		CreateCloth(_replacement, ClothSide, 6, Math::Vec<3>(0.0), 50);
+		_engine.RegisterObject(&_replacement);
+	}
+
+	// Static spheres out of the way, registered one by one.
+	void RegisterStressObjects()
+	{
+		using ShapeType = PhysicalObject::PhysicalValues::ShapeType;
+
+		for (PhysicalObject& object : _stressObjects) {
+			auto& params = object.PhysicalParams;
+			params.Shape = ShapeType::Sphere;
+			params.Radius = 0.1;
+			params.Matrix =
+				Math::Translate(Math::Vec<3>({0, 0, -100}));
+			params.Enabled = true;
+
+			_engine.RegisterObject(&object);
+		}
+	}
+
+private:
+	PhysicalEngine _engine;
+	PhysicalObject _terrain;
+	PhysicalObject _marker;
+	PhysicalObject _platforms[2];
+	std::vector<SoftObject> _cloths;
+	SoftObject _replacement;
+	std::vector<PhysicalObject> _stressObjects;
+	PhysicalEngine::ObjectHandle _markerHandle;
+	PhysicalEngine::SoftObjectHandle _clothHandles[ClothCount];
+};
+
+static bool IsSame(
+	const std::vector<PhysicsVec3>& first,
+	const std::vector<PhysicsVec3>& second)
+{
+	return
+		first.size() == second.size() &&
+		memcmp(
+			first.data(),
+			second.data(),
+			first.size() * sizeof(PhysicsVec3)) == 0;
+}
+
+int main()
+{
+	Logger::SetLevel(Logger::Level::Error);
+
+	ThreadPool threadPool;
+	Scene scene;
+	PhysicalEngine& engine = scene.GetEngine();
+
+	for (uint32_t tick = 0; tick < WarmupTicks; ++tick) {
+		scene.Run(&threadPool, tick);
+	}
+
+	std::vector<uint8_t> snapshot;
+	engine.SaveSnapshot(snapshot);
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t idx = 0; idx < Repeats; ++idx) {
+		engine.SaveSnapshot(snapshot);
+	}
+
+	double saveMs = GetMilliseconds(start) / Repeats;
+
+	std::vector<PhysicsVec3> original;
+	std::vector<PhysicsVec3> replayed;
+
+	for (uint32_t tick = 0; tick < ReplayTicks; ++tick) {
+		scene.Run(&threadPool, WarmupTicks + tick);
+	}
+
+	scene.GetPositions(original);
+
+	start = std::chrono::high_resolution_clock::now();
+	bool restored = true;
+
+	for (uint32_t idx = 0; idx < Repeats; ++idx) {
+		restored &= engine.RestoreSnapshot(snapshot);
+	}
+
+	double restoreMs = GetMilliseconds(start) / Repeats;
+
+	for (uint32_t tick = 0; tick < ReplayTicks; ++tick) {
+		scene.Run(&threadPool, WarmupTicks + tick);
+	}
+
+	scene.GetPositions(replayed);
+	bool replayMatches = restored && IsSame(original, replayed);
+
+	// The marker is registered before the platforms, so removing it
+	// swaps them in the dense descriptor order.
+	Math::Mat<4> savedMatrices[2];
+	engine.RestoreSnapshot(snapshot);
+
+	for (uint32_t idx = 0; idx < 2; ++idx) {
+		savedMatrices[idx] =
+			scene.GetPlatform(idx).PhysicalParams.Matrix;
+	}
+
+	scene.RemoveMarker();
+	scene.Run(&threadPool, 0);
+
+	bool handlesMatch = engine.RestoreSnapshot(snapshot);
+
+	for (uint32_t idx = 0; idx < 2; ++idx) {
+		const Math::Mat<4>& matrix =
+			scene.GetPlatform(idx).PhysicalParams.Matrix;
+
+		handlesMatch &= memcmp(
+			matrix.Data,
+			savedMatrices[idx].Data,
+			sizeof(matrix.Data)) == 0;
+	}
+
+	// Errors are expected from here on.
+	Logger::SetLevel(Logger::Level::Silent);
+	scene.ReplaceFirstCloth();
+	scene.Run(&threadPool, 0);
+
+	bool staleRefused = !engine.RestoreSnapshot(snapshot);
+
+	// Registrations are only applied by Run, so every snapshot of
+	// the loop stays valid.
+	std::atomic<bool> registering(true);
+	std::thread registration(
+		[&scene, &registering]() -> void
+		{
+			scene.RegisterStressObjects();
+			registering = false;
+		});
+
+	uint32_t stressSnapshots = 0;
+	bool stressRestored = true;
+
+	do {
+		engine.SaveSnapshot(snapshot);
+		stressRestored &= engine.RestoreSnapshot(snapshot);
+		++stressSnapshots;
+	} while (registering);
+
+	registration.join();
+	scene.Run(&threadPool, 0);
+
+	printf(
+		"%u soft vertices, snapshot %.2f MB, "
+		"save %.3f ms, restore %.3f ms\n",
+		ClothCount * ClothSide * ClothSide,
+		snapshot.size() / (1024.0 * 1024.0),
+		saveMs,
+		restoreMs);
+	printf(
+		"resimulation %s, restore after reordering %s, "
+		"stale snapshot %s\n",
+		replayMatches ? "matches" : "differs",
+		handlesMatch ? "matches" : "differs",
+		staleRefused ? "refused" : "accepted");
+	printf(
+		"%u snapshots during %u registrations %s\n",
+		stressSnapshots,
+		StressObjects,
+		stressRestored ? "restored" : "failed");
+
+	bool passed =
+		replayMatches &&
+		handlesMatch &&
+		staleRefused &&
+		stressRestored;
+
+	return passed ? 0 : 1;
+}
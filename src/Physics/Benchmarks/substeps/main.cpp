@@ -0,0 +1,136 @@
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+#include "../BenchmarkScene.h"
+#include "../../PhysicalEngine.h"
+#include "../../LinkSolver.h"
+#include "../../../Logger/logger.h"
+
+// Compares per-object substepping against the old way of keeping a
+// stiff object stable, lowering the tick for everything. A few stiff
+// cloths among many soft ones are simulated for the same time both
+// ways. Work is counted in vertex integration steps.
+
+static const double TickLength = 0.02;
+static const uint32_t Ticks = 100;
+static const uint32_t SoftCloths = 16;
+static const uint32_t StiffCloths = 2;
+static const uint32_t ClothSide = 24;
+
+struct Result
+{
+	double Milliseconds;
+	uint64_t Work;
+	bool Stable;
+	Math::Vec<3> StiffCentroid;
+};
+
+static Result Simulate(ThreadPool* threadPool, uint32_t ticksPerTick)
+{
+	PhysicalEngine engine;
+	PhysicalObject terrain;
+	std::vector<SoftObject> cloths(SoftCloths + StiffCloths);
+
+	CreateTerrain(terrain, 120, 30, 0.3);
+	engine.RegisterObject(&terrain);
+
+	for (uint32_t idx = 0; idx < cloths.size(); ++idx) {
+		double k = idx < SoftCloths ? 50 : 5000;
+		Math::Vec<3> center({
+			-12.0 + 3.0 * (idx % 9),
+			-6.0 + 4.0 * (idx / 9),
+			1.5});
+
+		CreateCloth(cloths[idx], ClothSide, 2, center, k);
+		engine.RegisterObject(&cloths[idx]);
+	}
+
+	double timeStep = TickLength / ticksPerTick;
+	LinkSolver solver;
+	Result result;
+	result.Work = 0;
+
+	for (SoftObject& cloth : cloths) {
+		result.Work +=
+			(uint64_t)cloth.SoftPhysicsParams.Vertices.size() *
+			solver.EstimateSubsteps(&cloth, timeStep) *
+			ticksPerTick * Ticks;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t tick = 0; tick < Ticks * ticksPerTick; ++tick) {
+		engine.Run(threadPool, timeStep);
+	}
+
+	result.Milliseconds = GetMilliseconds(start);
+	result.Stable = true;
+	result.StiffCentroid = Math::Vec<3>(0.0);
+
+	for (uint32_t idx = 0; idx < cloths.size(); ++idx) {
+		auto& vertices = cloths[idx].SoftPhysicsParams.Vertices;
+
+		for (auto& position : vertices.GetPositions()) {
+			result.Stable &= std::isfinite(position.Length());
+
+			if (idx >= SoftCloths) {
+				result.StiffCentroid += Math::Vec<3>(position);
+			}
+		}
+	}
+
+	result.StiffCentroid /= StiffCloths * ClothSide * ClothSide;
+
+	return result;
+}
+
+static void Print(const char* name, const Result& result)
+{
+	printf(
+		"%-10s %8.1f ms %12llu vertex steps, %s, "
+		"stiff centroid %.3f %.3f %.3f\n",
+		name,
+		result.Milliseconds,
+		(unsigned long long)result.Work,
+		result.Stable ? "stable" : "unstable",
+		result.StiffCentroid[0],
+		result.StiffCentroid[1],
+		result.StiffCentroid[2]);
+}
+
+int main()
+{
+	Logger::SetLevel(Logger::Level::Error);
+
+	ThreadPool threadPool;
+
+	// The tick the stiff cloths need when everything is stepped alike.
+	SoftObject stiff;
+	CreateCloth(stiff, ClothSide, 2, Math::Vec<3>(0.0), 5000);
+	LinkSolver solver;
+	uint32_t divisor = solver.EstimateSubsteps(&stiff, TickLength);
+
+	printf(
+		"%u soft and %u stiff cloths of %u vertices, "
+		"%u ticks of %.3f s, uniform tick %.4f s\n",
+		SoftCloths,
+		StiffCloths,
+		ClothSide * ClothSide,
+		Ticks,
+		TickLength,
+		TickLength / divisor);
+
+	Result substepped = Simulate(&threadPool, 1);
+	Result uniform = Simulate(&threadPool, divisor);
+
+	Print("substepped", substepped);
+	Print("uniform", uniform);
+
+	printf(
+		"uniform / substepped: %.2fx work, %.2fx time\n",
+		(double)uniform.Work / substepped.Work,
+		uniform.Milliseconds / substepped.Milliseconds);
+
+	return 0;
+}
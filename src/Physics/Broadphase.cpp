@@ -0,0 +1,349 @@
+#include "Broadphase.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+int Broadphase::SelectAxis(
+	const std::vector<Box>& first,
+	const std::vector<Box>& second)
+{
+	// Sweep along the axis with the largest spread of box centers.
+	// Unbounded boxes, like planes, have no center and are skipped.
+	Math::Vec<3> sum(0.0);
+	Math::Vec<3> sumSq(0.0);
+	Math::Vec<3> count(0.0);
+
+	for (const std::vector<Box>* boxes : {&first, &second}) {
+		for (const Box& box : *boxes) {
+			for (int i = 0; i < 3; ++i) {
+				double center = (box.Min[i] + box.Max[i]) / 2.0;
+
+				if (!std::isfinite(center)) {
+					continue;
+				}
+
+				sum[i] += center;
+				sumSq[i] += center * center;
+				count[i] += 1;
+			}
+		}
+	}
+
+	int axis = 0;
+	double maxVariance = -1;
+
+	for (int i = 0; i < 3; ++i) {
+		if (count[i] == 0) {
+			continue;
+		}
+
+		double variance = sumSq[i] - sum[i] * sum[i] / count[i];
+
+		if (variance > maxVariance) {
+			maxVariance = variance;
+			axis = i;
+		}
+	}
+
+	return axis;
+}
+
+// Assigns each box the index of its filter among the distinct ones,
+// false if there are more than MaxGroups of them.
+bool Broadphase::GroupFilters(
+	const std::vector<Filter>& filters,
+	std::vector<Filter>& groupFilters,
+	std::vector<uint32_t>& boxGroups)
+{
+	groupFilters.clear();
+	boxGroups.resize(filters.size());
+
+	for (size_t idx = 0; idx < filters.size(); ++idx) {
+		const Filter& filter = filters[idx];
+		uint32_t group = 0;
+
+		while (group < groupFilters.size()) {
+			const Filter& other = groupFilters[group];
+			bool same =
+				other.Category == filter.Category &&
+				other.Mask == filter.Mask;
+
+			if (same) {
+				break;
+			}
+
+			++group;
+		}
+
+		if (group == groupFilters.size()) {
+			if (group == MaxGroups) {
+				return false;
+			}
+
+			groupFilters.push_back(filter);
+		}
+
+		boxGroups[idx] = group;
+	}
+
+	return true;
+}
+
+size_t Broadphase::FindPairs(
+	const std::vector<Box>& first,
+	const std::vector<Filter>& firstFilters,
+	const std::vector<Box>& second,
+	const std::vector<Filter>& secondFilters,
+	std::vector<Pair>& pairs)
+{
+	pairs.clear();
+
+	if (first.empty() || second.empty()) {
+		return 0;
+	}
+
+	int axis = SelectAxis(first, second);
+
+	_entries.clear();
+
+	for (uint32_t idx = 0; idx < first.size(); ++idx) {
+		_entries.push_back({first[idx].Min[axis], idx, true});
+	}
+
+	for (uint32_t idx = 0; idx < second.size(); ++idx) {
+		_entries.push_back({second[idx].Min[axis], idx, false});
+	}
+
+	std::sort(
+		_entries.begin(),
+		_entries.end(),
+		[](const Entry& e1, const Entry& e2) -> bool
+		{
+			return e1.Min < e2.Min;
+		});
+
+	bool grouped =
+		GroupFilters(firstFilters, _groupFilters[0], _boxGroups[0]) &&
+		GroupFilters(secondFilters, _groupFilters[1], _boxGroups[1]);
+
+	for (int set = 0; set < 2; ++set) {
+		size_t groupCount = grouped ? _groupFilters[set].size() : 1;
+		_groupEntries[set].resize(groupCount);
+
+		for (std::vector<uint32_t>& entries : _groupEntries[set]) {
+			entries.clear();
+		}
+	}
+
+	for (uint32_t position = 0; position < _entries.size(); ++position) {
+		const Entry& entry = _entries[position];
+		int set = entry.First ? 0 : 1;
+		uint32_t group = grouped ? _boxGroups[set][entry.Index] : 0;
+
+		_groupEntries[set][group].push_back(position);
+	}
+
+	size_t filtered = 0;
+
+	for (size_t idx1 = 0; idx1 < _groupEntries[0].size(); ++idx1) {
+		const std::vector<uint32_t>& firstEntries =
+			_groupEntries[0][idx1];
+
+		for (size_t idx2 = 0; idx2 < _groupEntries[1].size(); ++idx2) {
+			const std::vector<uint32_t>& secondEntries =
+				_groupEntries[1][idx2];
+
+			bool rejected =
+				grouped &&
+				!_groupFilters[0][idx1].Accepts(
+					_groupFilters[1][idx2]);
+
+			if (rejected) {
+				filtered += firstEntries.size() *
+					secondEntries.size();
+				continue;
+			}
+
+			filtered += Sweep(
+				axis,
+				first,
+				firstFilters,
+				firstEntries,
+				second,
+				secondFilters,
+				secondEntries,
+				!grouped,
+				pairs);
+		}
+	}
+
+	return filtered;
+}
+
+size_t Broadphase::Sweep(
+	int axis,
+	const std::vector<Box>& first,
+	const std::vector<Filter>& firstFilters,
+	const std::vector<uint32_t>& firstEntries,
+	const std::vector<Box>& second,
+	const std::vector<Filter>& secondFilters,
+	const std::vector<uint32_t>& secondEntries,
+	bool checkFilters,
+	std::vector<Pair>& pairs)
+{
+	size_t filtered = 0;
+
+	_activeFirst.clear();
+	_activeSecond.clear();
+
+	auto prune = [axis](
+		std::vector<uint32_t>& active,
+		const std::vector<Box>& boxes,
+		double position)
+	{
+		size_t kept = 0;
+
+		for (size_t idx = 0; idx < active.size(); ++idx) {
+			if (boxes[active[idx]].Max[axis] >= position) {
+				active[kept] = active[idx];
+				++kept;
+			}
+		}
+
+		active.resize(kept);
+	};
+
+	size_t firstNext = 0;
+	size_t secondNext = 0;
+
+	// Merges the two position lists back into the sorted order.
+	while (firstNext < firstEntries.size() ||
+		secondNext < secondEntries.size())
+	{
+		bool takeFirst =
+			secondNext == secondEntries.size() || (
+				firstNext < firstEntries.size() &&
+				firstEntries[firstNext] <
+					secondEntries[secondNext]);
+		const Entry& entry = takeFirst ?
+			_entries[firstEntries[firstNext++]] :
+			_entries[secondEntries[secondNext++]];
+
+		prune(_activeFirst, first, entry.Min);
+		prune(_activeSecond, second, entry.Min);
+
+		if (entry.First) {
+			const Box& box = first[entry.Index];
+			const Filter& filter = firstFilters[entry.Index];
+
+			for (uint32_t other : _activeSecond) {
+				bool accepted =
+					!checkFilters ||
+					filter.Accepts(secondFilters[other]);
+
+				if (!accepted) {
+					++filtered;
+					continue;
+				}
+
+				if (box.Overlaps(second[other])) {
+					pairs.push_back({entry.Index, other});
+				}
+			}
+
+			_activeFirst.push_back(entry.Index);
+		} else {
+			const Box& box = second[entry.Index];
+			const Filter& filter = secondFilters[entry.Index];
+
+			for (uint32_t other : _activeFirst) {
+				bool accepted =
+					!checkFilters ||
+					filter.Accepts(firstFilters[other]);
+
+				if (!accepted) {
+					++filtered;
+					continue;
+				}
+
+				if (box.Overlaps(first[other])) {
+					pairs.push_back({other, entry.Index});
+				}
+			}
+
+			_activeSecond.push_back(entry.Index);
+		}
+	}
+
+	return filtered;
+}
+
+void Broadphase::Index(const std::vector<Box>& boxes)
+{
+	bool same =
+		boxes.size() == _indexBoxes.size() &&
+		memcmp(
+			(const void*)boxes.data(),
+			(const void*)_indexBoxes.data(),
+			boxes.size() * sizeof(Box)) == 0;
+
+	if (same) {
+		return;
+	}
+
+	_indexBoxes = boxes;
+	_indexEntries.clear();
+	_indexReach.clear();
+	_longBoxes.clear();
+
+	if (boxes.empty()) {
+		return;
+	}
+
+	_indexAxis = SelectAxis(boxes, {});
+	_lengths.clear();
+
+	for (const Box& box : boxes) {
+		double length = box.Max[_indexAxis] - box.Min[_indexAxis];
+
+		if (std::isfinite(length)) {
+			_lengths.push_back(length);
+		}
+	}
+
+	double maxLength = INFINITY;
+
+	if (!_lengths.empty()) {
+		auto median = _lengths.begin() + _lengths.size() / 2;
+		std::nth_element(_lengths.begin(), median, _lengths.end());
+		maxLength = *median * LongBoxFactor;
+	}
+
+	for (uint32_t idx = 0; idx < boxes.size(); ++idx) {
+		const Box& box = boxes[idx];
+		double length = box.Max[_indexAxis] - box.Min[_indexAxis];
+
+		if (!(length <= maxLength)) {
+			_longBoxes.push_back(idx);
+			continue;
+		}
+
+		_indexEntries.push_back({box.Min[_indexAxis], idx, true});
+	}
+
+	std::sort(
+		_indexEntries.begin(),
+		_indexEntries.end(),
+		[](const Entry& e1, const Entry& e2) -> bool
+		{
+			return e1.Min < e2.Min;
+		});
+
+	double reach = -INFINITY;
+
+	for (const Entry& entry : _indexEntries) {
+		reach = std::max(reach, boxes[entry.Index].Max[_indexAxis]);
+		_indexReach.push_back(reach);
+	}
+}
@@ -0,0 +1,177 @@
+#ifndef _BROADPHASE_H
+#define _BROADPHASE_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "../Math/vec.h"
+
+// Sweep and prune between two sets of axis aligned boxes, and queries
+// against one set sorted along the sweep axis.
+class Broadphase
+{
+public:
+	struct Box
+	{
+		Math::Vec<3> Min;
+		Math::Vec<3> Max;
+
+		bool Overlaps(const Box& box) const
+		{
+			for (int i = 0; i < 3; ++i) {
+				if (Min[i] > box.Max[i]) {
+					return false;
+				}
+
+				if (Max[i] < box.Min[i]) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+	};
+
+	// Two boxes pair only if each one's Category shares a bit with
+	// the other's Mask.
+	struct Filter
+	{
+		uint32_t Category;
+		uint32_t Mask;
+
+		bool Accepts(const Filter& filter) const
+		{
+			return
+				(Category & filter.Mask) &&
+				(filter.Category & Mask);
+		}
+	};
+
+	struct Pair
+	{
+		uint32_t First;
+		uint32_t Second;
+	};
+
+	Broadphase()
+	{
+		_indexAxis = 0;
+	}
+
+	// Finds all overlapping (first set, second set) box pairs whose
+	// filters accept each other. Pairs within one set are not
+	// reported. Boxes with equal filters are swept as a group, and
+	// groups whose filters reject each other are not swept against
+	// each other at all. Returns the number of box pairs skipped
+	// that way. Sets with more than MaxGroups distinct filters are
+	// swept at once, checking the filters of each candidate, and
+	// the candidates rejected are counted instead. Internal buffers
+	// are kept between calls.
+	size_t FindPairs(
+		const std::vector<Box>& first,
+		const std::vector<Filter>& firstFilters,
+		const std::vector<Box>& second,
+		const std::vector<Filter>& secondFilters,
+		std::vector<Pair>& pairs);
+
+	// Sorts boxes along the axis of their largest spread for Query.
+	// Boxes much longer along it than most, like terrains and
+	// planes, are kept apart and tested by every query. Indexing
+	// the same boxes again does not sort them again.
+	void Index(const std::vector<Box>& boxes);
+
+	// Calls action(index) for each indexed box that overlaps box.
+	template<typename Action>
+	void Query(const Box& box, Action action) const
+	{
+		for (uint32_t index : _longBoxes) {
+			if (_indexBoxes[index].Overlaps(box)) {
+				action(index);
+			}
+		}
+
+		// Walks down from the last box starting before box ends
+		// until no earlier box reaches into it.
+		auto end = std::upper_bound(
+			_indexEntries.begin(),
+			_indexEntries.end(),
+			box.Max[_indexAxis],
+			[](double position, const Entry& entry) -> bool
+			{
+				return position < entry.Min;
+			});
+
+		for (size_t idx = end - _indexEntries.begin(); idx > 0; --idx) {
+			if (_indexReach[idx - 1] < box.Min[_indexAxis]) {
+				break;
+			}
+
+			uint32_t index = _indexEntries[idx - 1].Index;
+
+			if (_indexBoxes[index].Overlaps(box)) {
+				action(index);
+			}
+		}
+	}
+
+private:
+	static const uint32_t MaxGroups = 8;
+
+	// Boxes longer than this many times the median length along the
+	// index axis are long boxes.
+	static const uint32_t LongBoxFactor = 8;
+
+	struct Entry
+	{
+		double Min;
+		uint32_t Index;
+		bool First;
+	};
+
+	// Entries of both sets sorted along the sweep axis.
+	std::vector<Entry> _entries;
+
+	// Per set, the distinct filters, the group of each box and the
+	// positions in _entries of each group's boxes.
+	std::vector<Filter> _groupFilters[2];
+	std::vector<uint32_t> _boxGroups[2];
+	std::vector<std::vector<uint32_t>> _groupEntries[2];
+
+	std::vector<uint32_t> _activeFirst;
+	std::vector<uint32_t> _activeSecond;
+
+	// Index of the boxes given to Index. Entries are sorted along
+	// the index axis, and the reach of an entry is the farthest
+	// any box up to it extends along the axis.
+	int _indexAxis;
+	std::vector<Box> _indexBoxes;
+	std::vector<Entry> _indexEntries;
+	std::vector<double> _indexReach;
+	std::vector<uint32_t> _longBoxes;
+	std::vector<double> _lengths;
+
+	static int SelectAxis(
+		const std::vector<Box>& first,
+		const std::vector<Box>& second);
+
+	static bool GroupFilters(
+		const std::vector<Filter>& filters,
+		std::vector<Filter>& groupFilters,
+		std::vector<uint32_t>& boxGroups);
+
+	// Sweeps the entries at the given positions of _entries against
+	// each other, in their sorted order.
+	size_t Sweep(
+		int axis,
+		const std::vector<Box>& first,
+		const std::vector<Filter>& firstFilters,
+		const std::vector<uint32_t>& firstEntries,
+		const std::vector<Box>& second,
+		const std::vector<Filter>& secondFilters,
+		const std::vector<uint32_t>& secondEntries,
+		bool checkFilters,
+		std::vector<Pair>& pairs);
+};
+
+#endif
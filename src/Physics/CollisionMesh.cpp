@@ -0,0 +1,52 @@
+#include "CollisionMesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+CollisionMesh::CollisionMesh()
+{
+	_refCounter = 1;
+}
+
+CollisionMesh* CollisionMesh::Create(
+	const std::vector<Math::Vec<3>>& vertices,
+	const std::vector<Math::Vec<3>>& normals,
+	const std::vector<uint32_t>& indices)
+{
+	CollisionMesh* mesh = new CollisionMesh;
+
+	mesh->_bvh.Build(vertices, indices);
+	mesh->_faceNormals.resize(indices.size() / 3);
+
+	for (size_t idx = 0; idx < mesh->_faceNormals.size(); ++idx) {
+		Math::Vec<3> normal =
+			normals[indices[idx * 3]] +
+			normals[indices[idx * 3 + 1]] +
+			normals[indices[idx * 3 + 2]];
+		mesh->_faceNormals[idx] = normal.Normalize();
+	}
+
+	mesh->_min = Math::Vec<3>(INFINITY);
+	mesh->_max = Math::Vec<3>(-INFINITY);
+
+	for (const Math::Vec<3>& vertex : vertices) {
+		for (int i = 0; i < 3; ++i) {
+			mesh->_min[i] = std::min(mesh->_min[i], vertex[i]);
+			mesh->_max[i] = std::max(mesh->_max[i], vertex[i]);
+		}
+	}
+
+	return mesh;
+}
+
+void CollisionMesh::IncRef()
+{
+	_refCounter.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CollisionMesh::DecRef()
+{
+	if (_refCounter.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		delete this;
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef _COLLISION_MESH_H
+#define _COLLISION_MESH_H
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+#include "../Math/vec.h"
+#include "PhysicsScalar.h"
+#include "MeshBVH.h"
+
+// Collision geometry in object space that many physical objects can
+// share. Only the BVH and face normals are kept, the source vertices
+// are not. Created with one reference owned by the caller; each
+// registered object holds one more.
+class CollisionMesh
+{
+public:
+	static CollisionMesh* Create(
+		const std::vector<Math::Vec<3>>& vertices,
+		const std::vector<Math::Vec<3>>& normals,
+		const std::vector<uint32_t>& indices);
+
+	void IncRef();
+	void DecRef();
+
+	const MeshBVH& GetBVH() const
+	{
+		return _bvh;
+	}
+
+	// Normalized sum of vertex normals per triangle, in index order.
+	const std::vector<PhysicsVec3>& GetFaceNormals() const
+	{
+		return _faceNormals;
+	}
+
+	const Math::Vec<3>& GetMin() const
+	{
+		return _min;
+	}
+
+	const Math::Vec<3>& GetMax() const
+	{
+		return _max;
+	}
+
+private:
+	std::atomic<uint32_t> _refCounter;
+
+	MeshBVH _bvh;
+	std::vector<PhysicsVec3> _faceNormals;
+
+	Math::Vec<3> _min;
+	Math::Vec<3> _max;
+
+	CollisionMesh();
+	~CollisionMesh() = default;
+};
+
+#endif
@@ -0,0 +1,289 @@
+#include "Heightfield.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "../Logger/logger.h"
+
+Heightfield::Heightfield()
+{
+	_width = 0;
+	_depth = 0;
+	_cellSize = 1;
+
+	_minHeight = 0;
+	_maxHeight = 0;
+}
+
+void Heightfield::Build(
+	std::vector<float>&& heights,
+	uint32_t width,
+	uint32_t depth,
+	double cellSize)
+{
+	_heights.clear();
+	_width = 0;
+	_depth = 0;
+
+	if (width < 2 || depth < 2 || heights.size() != width * depth) {
+		Logger::Error() << "Invalid heightfield size.";
+		return;
+	}
+
+	_heights = std::move(heights);
+	_width = width;
+	_depth = depth;
+	_cellSize = cellSize;
+
+	auto range = std::minmax_element(_heights.begin(), _heights.end());
+	_minHeight = *range.first;
+	_maxHeight = *range.second;
+}
+
+bool Heightfield::GetHeight(double x, double y, double& height) const
+{
+	if (_heights.empty()) {
+		return false;
+	}
+
+	double fx = x / _cellSize;
+	double fy = y / _cellSize;
+
+	if (!(fx >= 0 && fx <= _width - 1 && fy >= 0 && fy <= _depth - 1)) {
+		return false;
+	}
+
+	uint32_t cellX = std::min<uint32_t>(fx, _width - 2);
+	uint32_t cellY = std::min<uint32_t>(fy, _depth - 2);
+
+	double u = fx - cellX;
+	double v = fy - cellY;
+
+	double h00 = GetSample(cellX, cellY);
+	double h10 = GetSample(cellX + 1, cellY);
+	double h01 = GetSample(cellX, cellY + 1);
+	double h11 = GetSample(cellX + 1, cellY + 1);
+
+	if (u >= v) {
+		height = h00 + u * (h10 - h00) + v * (h11 - h10);
+	} else {
+		height = h00 + v * (h01 - h00) + u * (h11 - h01);
+	}
+
+	return true;
+}
+
+Math::Vec<3> Heightfield::GetMin() const
+{
+	return Math::Vec<3>({0.0, 0.0, (double)_minHeight});
+}
+
+Math::Vec<3> Heightfield::GetMax() const
+{
+	return Math::Vec<3>({
+		_cellSize * (_width - 1),
+		_cellSize * (_depth - 1),
+		(double)_maxHeight});
+}
+
+static bool IntersectTriangle(
+	const Math::Vec<3>& v0,
+	const Math::Vec<3>& v1,
+	const Math::Vec<3>& v2,
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double& distance,
+	Math::Vec<3>& normal)
+{
+	Math::Vec<3> faceNormal = (v1 - v0).Cross(v2 - v0);
+	double denominator = faceNormal.Dot(direction);
+
+	// Back faces and parallel rays.
+	if (!(denominator < 0)) {
+		return false;
+	}
+
+	double t = faceNormal.Dot(v0 - source) / denominator;
+
+	if (!(t >= 0 && t <= distance)) {
+		return false;
+	}
+
+	Math::Vec<3> point = source + direction * t;
+
+	if ((v1 - v0).Cross(point - v0).Dot(faceNormal) < 0 ||
+		(v2 - v1).Cross(point - v1).Dot(faceNormal) < 0 ||
+		(v0 - v2).Cross(point - v2).Dot(faceNormal) < 0)
+	{
+		return false;
+	}
+
+	distance = t;
+	normal = faceNormal.Normalize();
+
+	return true;
+}
+
+bool Heightfield::IntersectCell(
+	uint32_t x,
+	uint32_t y,
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double& distance,
+	Math::Vec<3>& normal) const
+{
+	double x0 = x * _cellSize;
+	double y0 = y * _cellSize;
+	double x1 = x0 + _cellSize;
+	double y1 = y0 + _cellSize;
+
+	Math::Vec<3> p00({x0, y0, (double)GetSample(x, y)});
+	Math::Vec<3> p10({x1, y0, (double)GetSample(x + 1, y)});
+	Math::Vec<3> p01({x0, y1, (double)GetSample(x, y + 1)});
+	Math::Vec<3> p11({x1, y1, (double)GetSample(x + 1, y + 1)});
+
+	bool hit = IntersectTriangle(
+		p00, p10, p11,
+		source,
+		direction,
+		distance,
+		normal);
+
+	hit |= IntersectTriangle(
+		p00, p11, p01,
+		source,
+		direction,
+		distance,
+		normal);
+
+	return hit;
+}
+
+bool Heightfield::Intersect(
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double& distance,
+	Math::Vec<3>& normal) const
+{
+	if (_heights.empty()) {
+		return false;
+	}
+
+	double height;
+
+	if (GetHeight(source[0], source[1], height) && source[2] < height) {
+		return false;
+	}
+
+	// Clip the ray to the bounds of the grid.
+	Math::Vec<3> min = GetMin();
+	Math::Vec<3> max = GetMax();
+	double enter = 0;
+	double exit = distance;
+
+	for (int i = 0; i < 3; ++i) {
+		if (direction[i] == 0) {
+			if (source[i] < min[i] || source[i] > max[i]) {
+				return false;
+			}
+
+			continue;
+		}
+
+		double t1 = (min[i] - source[i]) / direction[i];
+		double t2 = (max[i] - source[i]) / direction[i];
+
+		if (t1 > t2) {
+			std::swap(t1, t2);
+		}
+
+		enter = std::max(enter, t1);
+		exit = std::min(exit, t2);
+	}
+
+	if (!(enter <= exit)) {
+		return false;
+	}
+
+	// Walk the cells under the ray in order of distance, so the first
+	// cell with a hit holds the nearest one.
+	Math::Vec<3> start = source + direction * enter;
+
+	int64_t cell[2];
+	int64_t step[2];
+	int64_t last[2] = {_width - 2, _depth - 2};
+	double next[2];
+	double delta[2];
+
+	for (int i = 0; i < 2; ++i) {
+		cell[i] = std::floor(start[i] / _cellSize);
+		cell[i] = std::max<int64_t>(0, std::min(cell[i], last[i]));
+
+		if (direction[i] > 0) {
+			step[i] = 1;
+			next[i] = ((cell[i] + 1) * _cellSize - source[i]) /
+				direction[i];
+			delta[i] = _cellSize / direction[i];
+		} else if (direction[i] < 0) {
+			step[i] = -1;
+			next[i] = (cell[i] * _cellSize - source[i]) /
+				direction[i];
+			delta[i] = -_cellSize / direction[i];
+		} else {
+			step[i] = 0;
+			next[i] = INFINITY;
+			delta[i] = INFINITY;
+		}
+	}
+
+	double cellEnter = enter;
+
+	while (true) {
+		double cellExit = std::min(exit, std::min(next[0], next[1]));
+
+		// Skip cells whose height range the ray passes over or under.
+		double z1 = source[2] + direction[2] * cellEnter;
+		double z2 = source[2] + direction[2] * cellExit;
+
+		float h00 = GetSample(cell[0], cell[1]);
+		float h10 = GetSample(cell[0] + 1, cell[1]);
+		float h01 = GetSample(cell[0], cell[1] + 1);
+		float h11 = GetSample(cell[0] + 1, cell[1] + 1);
+
+		double low = std::min(std::min(h00, h10), std::min(h01, h11));
+		double high = std::max(std::max(h00, h10), std::max(h01, h11));
+
+		bool overlaps =
+			std::min(z1, z2) <= high &&
+			std::max(z1, z2) >= low;
+
+		if (overlaps) {
+			bool hit = IntersectCell(
+				cell[0],
+				cell[1],
+				source,
+				direction,
+				distance,
+				normal);
+
+			if (hit) {
+				return true;
+			}
+		}
+
+		if (cellExit >= exit) {
+			return false;
+		}
+
+		int axis = next[0] < next[1] ? 0 : 1;
+		cell[axis] += step[axis];
+
+		if (cell[axis] < 0 || cell[axis] > last[axis]) {
+			return false;
+		}
+
+		cellEnter = next[axis];
+		next[axis] += delta[axis];
+	}
+}
@@ -0,0 +1,134 @@
+#ifndef _HEIGHTFIELD_H
+#define _HEIGHTFIELD_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "../Math/vec.h"
+
+// Regular grid of heights in object space. Sample (x, y) lies at
+// (x * cellSize, y * cellSize, height), each cell is split into two
+// triangles along its (0, 0) - (1, 1) diagonal. Solid below the
+// surface.
+class Heightfield
+{
+public:
+	Heightfield();
+
+	// Samples are stored row by row, width samples along x per row.
+	// They are moved in, heights is left untouched only if invalid.
+	void Build(
+		std::vector<float>&& heights,
+		uint32_t width,
+		uint32_t depth,
+		double cellSize);
+
+	// Surface height above (x, y), false outside of the grid.
+	bool GetHeight(double x, double y, double& height) const;
+
+	// Same contract as the primitive ray tests in Primitives.h: rays
+	// starting below the surface do not hit it.
+	bool Intersect(
+		const Math::Vec<3>& source,
+		const Math::Vec<3>& direction,
+		double& distance,
+		Math::Vec<3>& normal) const;
+
+	Math::Vec<3> GetMin() const;
+	Math::Vec<3> GetMax() const;
+
+	// Visits the triangles of cells overlapping the box from min to
+	// max as visit(v0, v1, v2) with upward winding, until it returns
+	// true.
+	template<typename Visit>
+	void ForEachTriangle(
+		const Math::Vec<3>& min,
+		const Math::Vec<3>& max,
+		Visit visit) const
+	{
+		if (_heights.empty()) {
+			return;
+		}
+
+		Math::Vec<3> fieldMax = GetMax();
+		int64_t first[2];
+		int64_t last[2];
+
+		for (int i = 0; i < 2; ++i) {
+			if (!(max[i] >= 0 && min[i] <= fieldMax[i])) {
+				return;
+			}
+
+			int64_t cells = (i == 0 ? _width : _depth) - 2;
+			double low = std::floor(min[i] / _cellSize);
+			double high = std::floor(max[i] / _cellSize);
+
+			first[i] = std::max<double>(0, low);
+			last[i] = std::min<double>(cells, high);
+		}
+
+		for (int64_t y = first[1]; y <= last[1]; ++y) {
+			for (int64_t x = first[0]; x <= last[0]; ++x) {
+				float h00 = GetSample(x, y);
+				float h10 = GetSample(x + 1, y);
+				float h01 = GetSample(x, y + 1);
+				float h11 = GetSample(x + 1, y + 1);
+
+				float low = std::min(
+					std::min(h00, h10),
+					std::min(h01, h11));
+				float high = std::max(
+					std::max(h00, h10),
+					std::max(h01, h11));
+
+				if (high < min[2] || low > max[2]) {
+					continue;
+				}
+
+				double x0 = x * _cellSize;
+				double y0 = y * _cellSize;
+				double x1 = x0 + _cellSize;
+				double y1 = y0 + _cellSize;
+
+				Math::Vec<3> p00({x0, y0, (double)h00});
+				Math::Vec<3> p10({x1, y0, (double)h10});
+				Math::Vec<3> p01({x0, y1, (double)h01});
+				Math::Vec<3> p11({x1, y1, (double)h11});
+
+				bool stop =
+					visit(p00, p10, p11) ||
+					visit(p00, p11, p01);
+
+				if (stop) {
+					return;
+				}
+			}
+		}
+	}
+
+private:
+	std::vector<float> _heights;
+	uint32_t _width;
+	uint32_t _depth;
+	double _cellSize;
+
+	float _minHeight;
+	float _maxHeight;
+
+	float GetSample(uint32_t x, uint32_t y) const
+	{
+		return _heights[y * _width + x];
+	}
+
+	bool IntersectCell(
+		uint32_t x,
+		uint32_t y,
+		const Math::Vec<3>& source,
+		const Math::Vec<3>& direction,
+		double& distance,
+		Math::Vec<3>& normal) const;
+};
+
+#endif
@@ -0,0 +1,686 @@
+#include "LinkSolver.h"
+
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+
+#include "PhysicsLanes.h"
+
+typedef SoftObject::SoftPhysicsValues::Link Link;
+
+// Links of a chunk are addressed through the color order, their
+// vertices through copies of their indices in the same order.
+// Positions and speeds are the vertex columns as flat scalars.
+struct LinkKernelData
+{
+	const uint32_t* Order;
+	const uint32_t* First;
+	const uint32_t* Second;
+	const Link* Links;
+	const PhysicsScalar* Positions;
+	const PhysicsScalar* Speeds;
+	PhysicsVec3* Forces;
+};
+
+// Spring force plus friction against the rate of length change, both
+// along the link. The AVX2 kernel evaluates the same expressions in
+// the same order, so both give the same results.
+static inline void SolveLink(const LinkKernelData& data, size_t idx)
+{
+	const Link& link = data.Links[data.Order[idx]];
+	const PhysicsScalar* position1 = data.Positions + 3 * data.First[idx];
+	const PhysicsScalar* position2 = data.Positions + 3 * data.Second[idx];
+	const PhysicsScalar* speed1 = data.Speeds + 3 * data.First[idx];
+	const PhysicsScalar* speed2 = data.Speeds + 3 * data.Second[idx];
+
+	PhysicsVec3 delta;
+	PhysicsVec3 deltaSpeed;
+
+	for (int i = 0; i < 3; ++i) {
+		delta[i] = position1[i] - position2[i];
+		deltaSpeed[i] = speed1[i] - speed2[i];
+	}
+
+	PhysicsScalar length = sqrt(
+		delta[0] * delta[0] +
+		delta[1] * delta[1] +
+		delta[2] * delta[2]);
+	PhysicsVec3 normDelta = delta / length;
+
+	PhysicsScalar lengthSpeed = 0;
+
+	for (int i = 0; i < 3; ++i) {
+		lengthSpeed += normDelta[i] * deltaSpeed[i];
+	}
+
+	PhysicsScalar magnitude =
+		link.K * (length - link.Length) +
+		link.Friction * lengthSpeed;
+
+	PhysicsVec3 force = normDelta * magnitude;
+
+	data.Forces[data.First[idx]] -= force;
+	data.Forces[data.Second[idx]] += force;
+}
+
+static void SolveLinksScalar(
+	const LinkKernelData& data,
+	size_t begin,
+	size_t end)
+{
+	for (size_t idx = begin; idx < end; ++idx) {
+		SolveLink(data, idx);
+	}
+}
+
+// Gathers LanesWidth links at a time, computes their forces across the
+// lanes and scatters them one link after another, so the serial group,
+// whose links may share vertices, is solved like the scalar way.
+__attribute__((target("avx2")))
+static void SolveLinksAVX2(
+	const LinkKernelData& data,
+	size_t begin,
+	size_t end)
+{
+	static_assert(
+		offsetof(Link, K) == offsetof(Link, Length) +
+			sizeof(PhysicsScalar) &&
+		offsetof(Link, Friction) == offsetof(Link, K) +
+			sizeof(PhysicsScalar),
+		"Link parameters must be consecutive");
+
+	const PhysicsScalar* sources[LanesWidth];
+	PhysicsScalar forces[3][LanesWidth];
+	size_t idx = begin;
+
+	for (; idx + LanesWidth <= end; idx += LanesWidth) {
+		const uint32_t* first = data.First + idx;
+		const uint32_t* second = data.Second + idx;
+
+		Lanes position1[3];
+		Lanes position2[3];
+		Lanes speed1[3];
+		Lanes speed2[3];
+		Lanes params[3];
+
+		for (int lane = 0; lane < LanesWidth; ++lane) {
+			sources[lane] = data.Positions + 3 * first[lane];
+		}
+
+		LanesGather3(sources, position1);
+
+		for (int lane = 0; lane < LanesWidth; ++lane) {
+			sources[lane] = data.Positions + 3 * second[lane];
+		}
+
+		LanesGather3(sources, position2);
+
+		for (int lane = 0; lane < LanesWidth; ++lane) {
+			sources[lane] = data.Speeds + 3 * first[lane];
+		}
+
+		LanesGather3(sources, speed1);
+
+		for (int lane = 0; lane < LanesWidth; ++lane) {
+			sources[lane] = data.Speeds + 3 * second[lane];
+		}
+
+		LanesGather3(sources, speed2);
+
+		for (int lane = 0; lane < LanesWidth; ++lane) {
+			const Link& link = data.Links[data.Order[idx + lane]];
+			sources[lane] = &link.Length;
+		}
+
+		LanesGather3(sources, params);
+
+		Lanes delta[3];
+		Lanes deltaSpeed[3];
+
+		for (int i = 0; i < 3; ++i) {
+			delta[i] = LanesSub(position1[i], position2[i]);
+			deltaSpeed[i] = LanesSub(speed1[i], speed2[i]);
+		}
+
+		Lanes length = LanesMul(delta[0], delta[0]);
+		length = LanesAdd(length, LanesMul(delta[1], delta[1]));
+		length = LanesAdd(length, LanesMul(delta[2], delta[2]));
+		length = LanesSqrt(length);
+
+		Lanes normDelta[3];
+		Lanes lengthSpeed = LanesZero();
+
+		for (int i = 0; i < 3; ++i) {
+			normDelta[i] = LanesDiv(delta[i], length);
+			lengthSpeed = LanesAdd(
+				lengthSpeed,
+				LanesMul(normDelta[i], deltaSpeed[i]));
+		}
+
+		// Length, K and Friction.
+		Lanes magnitude = LanesAdd(
+			LanesMul(params[1], LanesSub(length, params[0])),
+			LanesMul(params[2], lengthSpeed));
+
+		for (int i = 0; i < 3; ++i) {
+			Lanes force = LanesMul(normDelta[i], magnitude);
+			LanesStore(forces[i], force);
+		}
+
+		for (int lane = 0; lane < LanesWidth; ++lane) {
+			PhysicsVec3 force({
+				forces[0][lane],
+				forces[1][lane],
+				forces[2][lane]});
+
+			data.Forces[first[lane]] -= force;
+			data.Forces[second[lane]] += force;
+		}
+	}
+
+	for (; idx < end; ++idx) {
+		SolveLink(data, idx);
+	}
+}
+
+typedef void (*LinkKernel)(
+	const LinkKernelData& data,
+	size_t begin,
+	size_t end);
+
+static LinkKernel SelectLinkKernel()
+{
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		return SolveLinksAVX2;
+	}
+
+	return SolveLinksScalar;
+}
+
+LinkSolver::LinkSolver()
+{
+	_serialTail = false;
+	_linkCount = 0;
+	_vertexCount = 0;
+}
+
+void LinkSolver::ColorLinks(SoftObject* object)
+{
+	auto& links = object->SoftPhysicsParams.Links;
+
+	_linkCount = links.size();
+	_vertexCount = object->SoftPhysicsParams.Vertices.size();
+
+	std::vector<uint64_t> usedColors(_vertexCount, 0);
+	std::vector<uint32_t> linkColors(_linkCount);
+	std::vector<size_t> colorSizes(MaxColors + 1, 0);
+
+	for (size_t idx = 0; idx < _linkCount; ++idx) {
+		auto& link = links[idx];
+
+		uint64_t used =
+			usedColors[link.Index1] |
+			usedColors[link.Index2];
+
+		uint32_t color = MaxColors;
+
+		if (~used) {
+			color = __builtin_ctzll(~used);
+
+			usedColors[link.Index1] |= 1ull << color;
+			usedColors[link.Index2] |= 1ull << color;
+		}
+
+		linkColors[idx] = color;
+		++colorSizes[color];
+	}
+
+	uint32_t colorCount = 0;
+
+	while (colorCount < MaxColors && colorSizes[colorCount] > 0) {
+		++colorCount;
+	}
+
+	_serialTail = colorSizes[MaxColors] > 0;
+	_colorOffsets.assign(1, 0);
+
+	for (uint32_t color = 0; color < colorCount; ++color) {
+		_colorOffsets.push_back(
+			_colorOffsets.back() + colorSizes[color]);
+	}
+
+	if (_serialTail) {
+		_colorOffsets.push_back(
+			_colorOffsets.back() + colorSizes[MaxColors]);
+	}
+
+	std::vector<size_t> positions(
+		_colorOffsets.begin(),
+		_colorOffsets.end() - 1);
+
+	_linkOrder.resize(_linkCount);
+	_linkFirst.resize(_linkCount);
+	_linkSecond.resize(_linkCount);
+
+	for (size_t idx = 0; idx < _linkCount; ++idx) {
+		uint32_t color = linkColors[idx];
+		uint32_t group = color == MaxColors ? colorCount : color;
+
+		_linkOrder[positions[group]] = idx;
+		_linkFirst[positions[group]] = links[idx].Index1;
+		_linkSecond[positions[group]] = links[idx].Index2;
+		++positions[group];
+	}
+}
+
+void LinkSolver::SolveLinks(SoftObject* object, size_t begin, size_t end)
+{
+	static const LinkKernel kernel = SelectLinkKernel();
+
+	auto& vertices = object->SoftPhysicsParams.Vertices;
+
+	LinkKernelData data;
+	data.Order = _linkOrder.data();
+	data.First = _linkFirst.data();
+	data.Second = _linkSecond.data();
+	data.Links = object->SoftPhysicsParams.Links.data();
+	data.Positions = vertices.GetPositions().data()->Data;
+	data.Speeds = vertices.GetSpeeds().data()->Data;
+	data.Forces = _forces.data();
+
+	kernel(data, begin, end);
+}
+
+size_t LinkSolver::GetLinkChunkSize(ThreadPool* threadPool, size_t count)
+{
+	size_t workers = threadPool->GetThreadCount() + 1;
+	size_t chunk = (count + workers - 1) / workers;
+
+	if (chunk < MinLinkChunkSize) {
+		chunk = MinLinkChunkSize;
+	}
+
+	return (chunk + LanesWidth - 1) / LanesWidth * LanesWidth;
+}
+
+uint32_t LinkSolver::EstimateSubsteps(SoftObject* object, double timeStep)
+{
+	if (
+		object->SoftPhysicsParams.Solver !=
+		SoftObject::SoftPhysicsValues::SolverType::Force)
+	{
+		return 1;
+	}
+
+	auto& links = object->SoftPhysicsParams.Links;
+	auto& vertices = object->SoftPhysicsParams.Vertices;
+	auto& inverseMasses = vertices.GetInverseMasses();
+
+	_stiffness.assign(vertices.size(), 0);
+	_damping.assign(vertices.size(), 0);
+
+	for (auto& link : links) {
+		_stiffness[link.Index1] += link.K;
+		_stiffness[link.Index2] += link.K;
+		_damping[link.Index1] += link.Friction;
+		_damping[link.Index2] += link.Friction;
+	}
+
+	// Gershgorin bounds of the largest stiffness and damping rates
+	// of the link system. Explicit integration stays stable while
+	// step * (sqrt(stiffness rate) + damping rate) is below 2.
+	PhysicsScalar maxStiffness = 0;
+	PhysicsScalar maxDamping = 0;
+
+	for (size_t idx = 0; idx < vertices.size(); ++idx) {
+		maxStiffness = std::max<PhysicsScalar>(
+			maxStiffness,
+			2 * _stiffness[idx] * inverseMasses[idx]);
+		maxDamping = std::max<PhysicsScalar>(
+			maxDamping,
+			2 * _damping[idx] * inverseMasses[idx]);
+	}
+
+	double rate = sqrt(maxStiffness) + maxDamping;
+	double substeps = ceil(timeStep * rate / 2.0);
+
+	if (!(substeps > 1)) {
+		return 1;
+	}
+
+	if (substeps > MaxSubsteps) {
+		return MaxSubsteps;
+	}
+
+	return substeps;
+}
+
+void LinkSolver::ApplyForces(
+	SoftObject* object,
+	ThreadPool* threadPool,
+	double timeStep)
+{
+	auto& links = object->SoftPhysicsParams.Links;
+	auto& vertices = object->SoftPhysicsParams.Vertices;
+
+	if (
+		links.size() != _linkCount ||
+		vertices.size() != _vertexCount ||
+		_colorOffsets.empty())
+	{
+		ColorLinks(object);
+		BuildAdjacency(object);
+	}
+
+	if (
+		object->SoftPhysicsParams.Solver !=
+		SoftObject::SoftPhysicsValues::SolverType::Force)
+	{
+		SolveConstraints(object, threadPool, timeStep);
+		return;
+	}
+
+	auto& speeds = vertices.GetSpeeds();
+	auto& vertexForces = vertices.GetForces();
+	auto& inverseMasses = vertices.GetInverseMasses();
+	PhysicsVec3 objectForce = object->SoftPhysicsParams.Force;
+	PhysicsScalar step = timeStep;
+
+	_forces.resize(vertices.size());
+
+	for (size_t idx = 0; idx < vertices.size(); ++idx) {
+		_forces[idx] = vertexForces[idx] + objectForce;
+	}
+
+	size_t groupCount = _colorOffsets.size() - 1;
+
+	for (size_t group = 0; group < groupCount; ++group) {
+		size_t begin = _colorOffsets[group];
+		size_t end = _colorOffsets[group + 1];
+
+		bool serial =
+			!threadPool ||
+			(_serialTail && group == groupCount - 1);
+
+		if (serial) {
+			SolveLinks(object, begin, end);
+			continue;
+		}
+
+		threadPool->ParallelFor(
+			end - begin,
+			GetLinkChunkSize(threadPool, end - begin),
+			[this, object, begin](size_t first, size_t last)
+			{
+				SolveLinks(object, begin + first, begin + last);
+			});
+	}
+
+	auto integrate = [&](size_t begin, size_t end) -> void
+	{
+		for (size_t idx = begin; idx < end; ++idx) {
+			speeds[idx] += _forces[idx] *
+				(inverseMasses[idx] * step);
+		}
+	};
+
+	ForEachVertex(threadPool, vertices.size(), integrate);
+}
+
+void LinkSolver::BuildAdjacency(SoftObject* object)
+{
+	auto& links = object->SoftPhysicsParams.Links;
+
+	_adjacencyOffsets.assign(_vertexCount + 1, 0);
+
+	for (auto& link : links) {
+		++_adjacencyOffsets[link.Index1 + 1];
+		++_adjacencyOffsets[link.Index2 + 1];
+	}
+
+	for (size_t idx = 0; idx < _vertexCount; ++idx) {
+		_adjacencyOffsets[idx + 1] += _adjacencyOffsets[idx];
+	}
+
+	std::vector<size_t> positions(
+		_adjacencyOffsets.begin(),
+		_adjacencyOffsets.end() - 1);
+
+	_adjacency.resize(_adjacencyOffsets.back());
+	_adjacentVertices.resize(_adjacencyOffsets.back());
+
+	for (size_t idx = 0; idx < links.size(); ++idx) {
+		size_t first = links[idx].Index1;
+		size_t second = links[idx].Index2;
+
+		_adjacency[positions[first]] = idx;
+		_adjacentVertices[positions[first]] = second;
+		++positions[first];
+
+		_adjacency[positions[second]] = idx;
+		_adjacentVertices[positions[second]] = first;
+		++positions[second];
+	}
+}
+
+bool LinkSolver::AreLinked(size_t first, size_t second) const
+{
+	for (
+		size_t idx = _adjacencyOffsets[first];
+		idx < _adjacencyOffsets[first + 1];
+		++idx)
+	{
+		if (_adjacentVertices[idx] == second) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+PhysicsScalar LinkSolver::SolveConstraint(
+	SoftObject* object,
+	size_t linkIndex,
+	PhysicsScalar step,
+	PhysicsVec3& direction)
+{
+	auto& link = object->SoftPhysicsParams.Links[linkIndex];
+	auto& vertices = object->SoftPhysicsParams.Vertices;
+	auto& positions = vertices.GetPositions();
+	auto& inverseMasses = vertices.GetInverseMasses();
+
+	PhysicsVec3 delta =
+		positions[link.Index1] -
+		positions[link.Index2];
+	PhysicsScalar length = delta.Length();
+
+	if (!(length > 0) || !(link.K > 0)) {
+		direction = PhysicsVec3(0.0);
+		return 0;
+	}
+
+	direction = delta / length;
+
+	PhysicsVec3 motion =
+		(positions[link.Index1] - _previousPositions[link.Index1]) -
+		(positions[link.Index2] - _previousPositions[link.Index2]);
+
+	// Compliance scaled by the step and the XPBD damping factor.
+	PhysicsScalar compliance = 1 / (link.K * step * step);
+	PhysicsScalar damping = link.Friction / (link.K * step);
+
+	PhysicsScalar weight =
+		inverseMasses[link.Index1] +
+		inverseMasses[link.Index2];
+
+	PhysicsScalar lambda =
+		-(length - link.Length) -
+		compliance * _lambdas[linkIndex] -
+		damping * direction.Dot(motion);
+	lambda /= (1 + damping) * weight + compliance;
+
+	_lambdas[linkIndex] += lambda;
+
+	return lambda;
+}
+
+void LinkSolver::JacobiIteration(
+	SoftObject* object,
+	ThreadPool* threadPool,
+	PhysicsScalar step)
+{
+	auto& links = object->SoftPhysicsParams.Links;
+	auto& vertices = object->SoftPhysicsParams.Vertices;
+	auto& positions = vertices.GetPositions();
+	auto& inverseMasses = vertices.GetInverseMasses();
+
+	auto solve = [this, object, step](size_t begin, size_t end) -> void
+	{
+		for (size_t idx = begin; idx < end; ++idx) {
+			PhysicsVec3 direction;
+			PhysicsScalar lambda = SolveConstraint(
+				object,
+				idx,
+				step,
+				direction);
+
+			_linkCorrections[idx] = direction * lambda;
+		}
+	};
+
+	if (threadPool) {
+		threadPool->ParallelFor(
+			links.size(),
+			GetLinkChunkSize(threadPool, links.size()),
+			solve);
+	} else {
+		solve(0, links.size());
+	}
+
+	// Corrections of a vertex are averaged over its links and
+	// over-relaxed to make up for the slower Jacobi convergence.
+	const PhysicsScalar relaxation = 1.5;
+
+	auto apply = [&](size_t begin, size_t end) -> void
+	{
+		for (size_t idx = begin; idx < end; ++idx) {
+			size_t first = _adjacencyOffsets[idx];
+			size_t last = _adjacencyOffsets[idx + 1];
+
+			if (first == last) {
+				continue;
+			}
+
+			PhysicsVec3 correction(0.0);
+
+			for (size_t adj = first; adj < last; ++adj) {
+				uint32_t link = _adjacency[adj];
+
+				if (links[link].Index1 == idx) {
+					correction += _linkCorrections[link];
+				} else {
+					correction -= _linkCorrections[link];
+				}
+			}
+
+			PhysicsScalar scale = relaxation / (last - first);
+
+			positions[idx] += correction *
+				(inverseMasses[idx] * scale);
+		}
+	};
+
+	ForEachVertex(threadPool, vertices.size(), apply);
+}
+
+void LinkSolver::SolveConstraints(
+	SoftObject* object,
+	ThreadPool* threadPool,
+	double timeStep)
+{
+	auto& params = object->SoftPhysicsParams;
+	auto& links = params.Links;
+	auto& positions = params.Vertices.GetPositions();
+	auto& speeds = params.Vertices.GetSpeeds();
+	auto& vertexForces = params.Vertices.GetForces();
+	auto& inverseMasses = params.Vertices.GetInverseMasses();
+	PhysicsVec3 objectForce = params.Force;
+	PhysicsScalar step = timeStep;
+	size_t vertexCount = params.Vertices.size();
+
+	_previousPositions.resize(vertexCount);
+	_lambdas.assign(links.size(), 0);
+	_linkCorrections.resize(links.size());
+
+	auto predict = [&](size_t begin, size_t end) -> void
+	{
+		for (size_t idx = begin; idx < end; ++idx) {
+			speeds[idx] += (vertexForces[idx] + objectForce) *
+				(inverseMasses[idx] * step);
+
+			_previousPositions[idx] = positions[idx];
+			positions[idx] += speeds[idx] * step;
+		}
+	};
+
+	ForEachVertex(threadPool, vertexCount, predict);
+
+	for (
+		uint32_t iteration = 0;
+		iteration < params.SolverIterations;
+		++iteration)
+	{
+		if (
+			params.Solver ==
+			SoftObject::SoftPhysicsValues::SolverType::Jacobi)
+		{
+			JacobiIteration(object, threadPool, step);
+			continue;
+		}
+
+		for (size_t idx = 0; idx < links.size(); ++idx) {
+			auto& link = links[idx];
+
+			PhysicsVec3 direction;
+			PhysicsScalar lambda = SolveConstraint(
+				object,
+				idx,
+				step,
+				direction);
+
+			positions[link.Index1] += direction *
+				(inverseMasses[link.Index1] * lambda);
+			positions[link.Index2] -= direction *
+				(inverseMasses[link.Index2] * lambda);
+		}
+	}
+
+	// Leave position integration to the collision pass, which
+	// moves the vertices back to the solved positions.
+	auto finish = [&](size_t begin, size_t end) -> void
+	{
+		for (size_t idx = begin; idx < end; ++idx) {
+			PhysicsVec3 motion =
+				positions[idx] - _previousPositions[idx];
+
+			speeds[idx] = motion / step;
+			positions[idx] = _previousPositions[idx];
+		}
+	};
+
+	ForEachVertex(threadPool, vertexCount, finish);
+}
+
+void LinkSolver::ForEachVertex(
+	ThreadPool* threadPool,
+	size_t count,
+	std::function<void(size_t, size_t)> action)
+{
+	if (threadPool) {
+		threadPool->ParallelFor(count, VertexChunkSize, action);
+	} else {
+		action(0, count);
+	}
+}
@@ -0,0 +1,107 @@
+#ifndef _LINK_SOLVER_H
+#define _LINK_SOLVER_H
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "SoftObject.h"
+#include "../Utils/ThreadPool.h"
+
+// Applies external and link spring forces to soft object vertex speeds.
+// Links are greedily colored so that links of one color share no
+// vertices; a color is then split across threads without atomics.
+// Within a chunk the AVX2 kernel gathers links into registers of one
+// color, computes their forces across the lanes and scatters them.
+// Coloring is redone when the link or vertex count changes.
+//
+// XPBD modes turn link forces into speed changes through distance
+// constraints instead. Jacobi iterations are split across threads via
+// a vertex to link adjacency, Gauss-Seidel iterations run serially.
+class LinkSolver
+{
+public:
+	LinkSolver();
+
+	// threadPool may be nullptr to solve on the calling thread.
+	void ApplyForces(
+		SoftObject* object,
+		ThreadPool* threadPool,
+		double timeStep);
+
+	// Valid for the topology of the last ApplyForces call.
+	bool AreLinked(size_t first, size_t second) const;
+
+	// Number of equal substeps timeStep has to be split into for
+	// the explicit integration of the links to stay stable. Always
+	// 1 for the constraint solvers.
+	uint32_t EstimateSubsteps(SoftObject* object, double timeStep);
+
+private:
+	static const uint32_t MaxColors = 64;
+	static const size_t MinLinkChunkSize = 256;
+	static const size_t VertexChunkSize = 4096;
+	static const uint32_t MaxSubsteps = 64;
+
+	// Link indices grouped by color, color c occupies
+	// [_colorOffsets[c], _colorOffsets[c + 1]). Links that did not fit
+	// into MaxColors form the last group, which is solved serially.
+	// Their vertex indices are kept in the same order for gathers.
+	std::vector<uint32_t> _linkOrder;
+	std::vector<uint32_t> _linkFirst;
+	std::vector<uint32_t> _linkSecond;
+	std::vector<size_t> _colorOffsets;
+	bool _serialTail;
+
+	size_t _linkCount;
+	size_t _vertexCount;
+
+	std::vector<PhysicsVec3> _forces;
+	std::vector<PhysicsScalar> _stiffness;
+	std::vector<PhysicsScalar> _damping;
+
+	// Links of vertex v are
+	// _adjacency[_adjacencyOffsets[v] .. _adjacencyOffsets[v + 1]),
+	// with their other vertices at the same positions in
+	// _adjacentVertices.
+	std::vector<size_t> _adjacencyOffsets;
+	std::vector<uint32_t> _adjacency;
+	std::vector<uint32_t> _adjacentVertices;
+
+	std::vector<PhysicsVec3> _previousPositions;
+	std::vector<PhysicsScalar> _lambdas;
+	std::vector<PhysicsVec3> _linkCorrections;
+
+	void ColorLinks(SoftObject* object);
+	void BuildAdjacency(SoftObject* object);
+	void SolveLinks(SoftObject* object, size_t begin, size_t end);
+
+	void SolveConstraints(
+		SoftObject* object,
+		ThreadPool* threadPool,
+		double timeStep);
+	void JacobiIteration(
+		SoftObject* object,
+		ThreadPool* threadPool,
+		PhysicsScalar step);
+
+	// Returns the multiplier change of one distance constraint and
+	// the direction from the second vertex to the first one.
+	PhysicsScalar SolveConstraint(
+		SoftObject* object,
+		size_t linkIndex,
+		PhysicsScalar step,
+		PhysicsVec3& direction);
+
+	// Splits count links evenly over the pool threads and the caller,
+	// in multiples of the SIMD width and no smaller than
+	// MinLinkChunkSize.
+	static size_t GetLinkChunkSize(ThreadPool* threadPool, size_t count);
+
+	static void ForEachVertex(
+		ThreadPool* threadPool,
+		size_t count,
+		std::function<void(size_t, size_t)> action);
+};
+
+#endif
@@ -0,0 +1,293 @@
+#include "MeshBVH.h"
+
+#include <algorithm>
+#include <limits>
+
+static double SurfaceArea(const Math::Vec<3>& min, const Math::Vec<3>& max)
+{
+	Math::Vec<3> size = max - min;
+
+	if (size[0] < 0) {
+		return 0;
+	}
+
+	return 2.0 * (
+		size[0] * size[1] +
+		size[1] * size[2] +
+		size[2] * size[0]);
+}
+
+// Triangles are tested a packet at a time, so that is what a node
+// costs in the surface area heuristic.
+static uint32_t GetPacketCount(uint32_t triangleCount)
+{
+	const uint32_t width = TrianglePacket::Width;
+
+	return (triangleCount + width - 1) / width;
+}
+
+static void Extend(
+	Math::Vec<3>& min,
+	Math::Vec<3>& max,
+	const Math::Vec<3>& pointMin,
+	const Math::Vec<3>& pointMax)
+{
+	for (int i = 0; i < 3; ++i) {
+		min[i] = std::min(min[i], pointMin[i]);
+		max[i] = std::max(max[i], pointMax[i]);
+	}
+}
+
+void MeshBVH::Clear()
+{
+	_nodes.clear();
+	_packets.clear();
+}
+
+void MeshBVH::Build(
+	const std::vector<Math::Vec<3>>& vertices,
+	const std::vector<uint32_t>& indices)
+{
+	Clear();
+
+	uint32_t triangleCount = indices.size() / 3;
+
+	if (triangleCount == 0) {
+		return;
+	}
+
+	std::vector<BuildTriangle> triangles(triangleCount);
+
+	for (uint32_t idx = 0; idx < triangleCount; ++idx) {
+		const Math::Vec<3>& v1 = vertices[indices[idx * 3]];
+		const Math::Vec<3>& v2 = vertices[indices[idx * 3 + 1]];
+		const Math::Vec<3>& v3 = vertices[indices[idx * 3 + 2]];
+
+		BuildTriangle& triangle = triangles[idx];
+		triangle.Min = v1;
+		triangle.Max = v1;
+		Extend(triangle.Min, triangle.Max, v2, v2);
+		Extend(triangle.Min, triangle.Max, v3, v3);
+		triangle.Center = (triangle.Min + triangle.Max) / 2.0;
+		triangle.Index = idx;
+	}
+
+	_nodes.reserve(triangleCount * 2 / MaxLeafSize + 1);
+	BuildNode(triangles, 0, triangleCount, 0);
+	BuildPackets(triangles, vertices, indices);
+}
+
+void MeshBVH::BuildPackets(
+	const std::vector<BuildTriangle>& triangles,
+	const std::vector<Math::Vec<3>>& vertices,
+	const std::vector<uint32_t>& indices)
+{
+	const uint32_t width = TrianglePacket::Width;
+
+	for (Node& node : _nodes) {
+		if (node.Count == 0) {
+			continue;
+		}
+
+		uint32_t first = node.Offset;
+		uint32_t count = node.Count;
+
+		node.Offset = _packets.size();
+		node.Count = (count + width - 1) / width;
+
+		for (uint32_t idx = 0; idx < node.Count * width; ++idx) {
+			if (idx % width == 0) {
+				_packets.push_back(TrianglePacket());
+			}
+
+			TrianglePacket& packet = _packets.back();
+			uint32_t lane = idx % width;
+
+			if (idx >= count) {
+				for (int i = 0; i < 3; ++i) {
+					packet.V0[i][lane] = 0;
+					packet.Edge1[i][lane] = 0;
+					packet.Edge2[i][lane] = 0;
+				}
+
+				packet.Triangles[lane] =
+					TrianglePacket::EmptyLane;
+				continue;
+			}
+
+			uint32_t triangle = triangles[first + idx].Index;
+
+			const Math::Vec<3>& v1 =
+				vertices[indices[triangle * 3]];
+			const Math::Vec<3>& v2 =
+				vertices[indices[triangle * 3 + 1]];
+			const Math::Vec<3>& v3 =
+				vertices[indices[triangle * 3 + 2]];
+
+			Math::Vec<3> edge1 = v2 - v1;
+			Math::Vec<3> edge2 = v3 - v1;
+
+			for (int i = 0; i < 3; ++i) {
+				packet.V0[i][lane] = v1[i];
+				packet.Edge1[i][lane] = edge1[i];
+				packet.Edge2[i][lane] = edge2[i];
+			}
+
+			packet.Triangles[lane] = triangle;
+		}
+	}
+}
+
+uint32_t MeshBVH::BuildNode(
+	std::vector<BuildTriangle>& triangles,
+	uint32_t begin,
+	uint32_t end,
+	uint32_t depth)
+{
+	const double inf = std::numeric_limits<double>::infinity();
+
+	uint32_t nodeIndex = _nodes.size();
+	_nodes.push_back(Node());
+
+	Math::Vec<3> min(inf);
+	Math::Vec<3> max(-inf);
+	Math::Vec<3> centerMin(inf);
+	Math::Vec<3> centerMax(-inf);
+
+	for (uint32_t idx = begin; idx < end; ++idx) {
+		Extend(min, max, triangles[idx].Min, triangles[idx].Max);
+		Extend(
+			centerMin,
+			centerMax,
+			triangles[idx].Center,
+			triangles[idx].Center);
+	}
+
+	_nodes[nodeIndex].Min = min;
+	_nodes[nodeIndex].Max = max;
+
+	uint32_t count = end - begin;
+
+	if (count <= MaxLeafSize || depth + 1 >= MaxDepth) {
+		_nodes[nodeIndex].Offset = begin;
+		_nodes[nodeIndex].Count = count;
+		return nodeIndex;
+	}
+
+	// Binned surface area heuristic.
+	struct Bin
+	{
+		Math::Vec<3> Min;
+		Math::Vec<3> Max;
+		uint32_t Count;
+	};
+
+	double bestCost = inf;
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+
+	for (int axis = 0; axis < 3; ++axis) {
+		double extent = centerMax[axis] - centerMin[axis];
+
+		if (extent <= 0) {
+			continue;
+		}
+
+		Bin bins[BinCount];
+
+		for (uint32_t bin = 0; bin < BinCount; ++bin) {
+			bins[bin].Min = Math::Vec<3>(inf);
+			bins[bin].Max = Math::Vec<3>(-inf);
+			bins[bin].Count = 0;
+		}
+
+		double scale = BinCount / extent;
+
+		for (uint32_t idx = begin; idx < end; ++idx) {
+			uint32_t bin = std::min<uint32_t>(
+				BinCount - 1,
+				(triangles[idx].Center[axis] -
+					centerMin[axis]) * scale);
+
+			Extend(
+				bins[bin].Min,
+				bins[bin].Max,
+				triangles[idx].Min,
+				triangles[idx].Max);
+			++bins[bin].Count;
+		}
+
+		double leftArea[BinCount - 1];
+		uint32_t leftCount[BinCount - 1];
+
+		Math::Vec<3> boxMin(inf);
+		Math::Vec<3> boxMax(-inf);
+		uint32_t sum = 0;
+
+		for (uint32_t bin = 0; bin < BinCount - 1; ++bin) {
+			Extend(boxMin, boxMax, bins[bin].Min, bins[bin].Max);
+			sum += bins[bin].Count;
+
+			leftArea[bin] = SurfaceArea(boxMin, boxMax);
+			leftCount[bin] = sum;
+		}
+
+		boxMin = Math::Vec<3>(inf);
+		boxMax = Math::Vec<3>(-inf);
+		sum = 0;
+
+		for (uint32_t bin = BinCount - 1; bin > 0; --bin) {
+			Extend(boxMin, boxMax, bins[bin].Min, bins[bin].Max);
+			sum += bins[bin].Count;
+
+			double cost =
+				leftArea[bin - 1] *
+					GetPacketCount(leftCount[bin - 1]) +
+				SurfaceArea(boxMin, boxMax) *
+					GetPacketCount(sum);
+
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = bin;
+			}
+		}
+	}
+
+	uint32_t middle = begin;
+
+	if (bestAxis >= 0) {
+		double extent = centerMax[bestAxis] - centerMin[bestAxis];
+		double scale = BinCount / extent;
+		double axisMin = centerMin[bestAxis];
+
+		auto split = std::partition(
+			triangles.begin() + begin,
+			triangles.begin() + end,
+			[bestAxis, bestSplit, scale, axisMin](
+				const BuildTriangle& triangle) -> bool
+			{
+				uint32_t bin = std::min<uint32_t>(
+					BinCount - 1,
+					(triangle.Center[bestAxis] - axisMin) *
+						scale);
+
+				return bin < bestSplit;
+			});
+
+		middle = split - triangles.begin();
+	}
+
+	if (middle == begin || middle == end) {
+		// Degenerate centroid distribution, split by count.
+		middle = begin + count / 2;
+	}
+
+	BuildNode(triangles, begin, middle, depth + 1);
+	uint32_t second = BuildNode(triangles, middle, end, depth + 1);
+
+	_nodes[nodeIndex].Offset = second;
+	_nodes[nodeIndex].Count = 0;
+
+	return nodeIndex;
+}
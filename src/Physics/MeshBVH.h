@@ -0,0 +1,402 @@
+#ifndef _MESH_BVH_H
+#define _MESH_BVH_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <utility>
+
+#include "../Math/vec.h"
+#include "PhysicsScalar.h"
+#include "TrianglePacket.h"
+
+// Bounding volume hierarchy over triangles of one collision mesh.
+// Nodes are stored depth-first in a flat array: the first child of an
+// inner node immediately follows it, the second child is at Offset.
+class MeshBVH
+{
+public:
+	struct Node
+	{
+		PhysicsVec3 Min;
+		PhysicsVec3 Max;
+
+		// Leaf: index of the first triangle packet.
+		// Inner node: index of the second child.
+		uint32_t Offset;
+
+		// Triangle packet count of a leaf, 0 for inner nodes.
+		uint32_t Count;
+	};
+
+	void Build(
+		const std::vector<Math::Vec<3>>& vertices,
+		const std::vector<uint32_t>& indices);
+	void Clear();
+
+	bool IsEmpty() const
+	{
+		return _nodes.empty();
+	}
+
+	const std::vector<Node>& GetNodes() const
+	{
+		return _nodes;
+	}
+
+	const std::vector<TrianglePacket>& GetPackets() const
+	{
+		return _packets;
+	}
+
+	// Visits triangle packets of all leaves crossed by the ray segment
+	// [source, source + direction * distance], nearest leaves first.
+	// test(packet, distance) returns true if a triangle was hit,
+	// shortening distance in that case.
+	template<typename Test>
+	bool Traverse(
+		const PhysicsVec3& source,
+		const PhysicsVec3& direction,
+		PhysicsScalar& distance,
+		Test test) const
+	{
+		return Traverse(source, direction, 0, distance, test);
+	}
+
+	// Same for a sphere of radius swept along the segment: node bounds
+	// are grown by radius before the ray test.
+	template<typename Test>
+	bool Traverse(
+		const PhysicsVec3& source,
+		const PhysicsVec3& direction,
+		PhysicsScalar radius,
+		PhysicsScalar& distance,
+		Test test) const
+	{
+		if (_nodes.empty()) {
+			return false;
+		}
+
+		PhysicsVec3 invDir;
+
+		for (int i = 0; i < 3; ++i) {
+			if (std::isnan(direction[i])) {
+				return false;
+			}
+
+			invDir[i] = PhysicsScalar(1) / direction[i];
+		}
+
+		uint32_t stack[MaxDepth];
+		uint32_t stackSize = 0;
+		uint32_t current = 0;
+
+		bool hit = false;
+		PhysicsScalar entry;
+
+		bool rootHit = IntersectNode(
+			_nodes[0],
+			source,
+			invDir,
+			radius,
+			distance,
+			entry);
+
+		if (!rootHit) {
+			return false;
+		}
+
+		while (true) {
+			const Node& node = _nodes[current];
+
+			if (node.Count > 0) {
+				for (uint32_t i = 0; i < node.Count; ++i) {
+					const TrianglePacket& packet =
+						_packets[node.Offset + i];
+
+					if (test(packet, distance)) {
+						hit = true;
+					}
+				}
+			} else {
+				uint32_t first = current + 1;
+				uint32_t second = node.Offset;
+
+				PhysicsScalar firstEntry;
+				PhysicsScalar secondEntry;
+
+				bool firstHit = IntersectNode(
+					_nodes[first],
+					source,
+					invDir,
+					radius,
+					distance,
+					firstEntry);
+
+				bool secondHit = IntersectNode(
+					_nodes[second],
+					source,
+					invDir,
+					radius,
+					distance,
+					secondEntry);
+
+				if (firstHit && secondHit) {
+					if (secondEntry < firstEntry) {
+						std::swap(first, second);
+					}
+
+					stack[stackSize] = second;
+					++stackSize;
+					current = first;
+					continue;
+				} else if (firstHit) {
+					current = first;
+					continue;
+				} else if (secondHit) {
+					current = second;
+					continue;
+				}
+			}
+
+			bool found = false;
+
+			while (stackSize > 0) {
+				--stackSize;
+				current = stack[stackSize];
+
+				found = IntersectNode(
+					_nodes[current],
+					source,
+					invDir,
+					radius,
+					distance,
+					entry);
+
+				if (found) {
+					break;
+				}
+			}
+
+			if (!found) {
+				break;
+			}
+		}
+
+		return hit;
+	}
+
+	// Visits triangle packets of all leaves whose bounds overlap the
+	// box from min to max, until visit(packet) returns true.
+	template<typename Visit>
+	void Query(
+		const PhysicsVec3& min,
+		const PhysicsVec3& max,
+		Visit visit) const
+	{
+		if (_nodes.empty()) {
+			return;
+		}
+
+		uint32_t stack[MaxDepth];
+		uint32_t stackSize = 0;
+
+		stack[stackSize] = 0;
+		++stackSize;
+
+		while (stackSize > 0) {
+			--stackSize;
+			uint32_t current = stack[stackSize];
+			const Node& node = _nodes[current];
+
+			bool overlaps = true;
+
+			for (int i = 0; i < 3; ++i) {
+				overlaps &=
+					node.Min[i] <= max[i] &&
+					node.Max[i] >= min[i];
+			}
+
+			if (!overlaps) {
+				continue;
+			}
+
+			if (node.Count > 0) {
+				for (uint32_t i = 0; i < node.Count; ++i) {
+					if (visit(_packets[node.Offset + i])) {
+						return;
+					}
+				}
+			} else {
+				stack[stackSize] = node.Offset;
+				++stackSize;
+				stack[stackSize] = current + 1;
+				++stackSize;
+			}
+		}
+	}
+
+	// Visits triangle packets of all leaves within distance of point,
+	// nearest leaves first. test(packet, distance) may shorten
+	// distance, which skips the leaves that are no longer within it.
+	template<typename Test>
+	void TraverseNearest(
+		const PhysicsVec3& point,
+		PhysicsScalar& distance,
+		Test test) const
+	{
+		TraverseNearest(
+			distance,
+			[&point](const PhysicsVec3& min, const PhysicsVec3& max)
+			{
+				return GetBoxDistance(min, max, point);
+			},
+			test);
+	}
+
+	// Same with nodeDistance(min, max) giving a lower bound of the
+	// distance to the points in a node box, for distances measured
+	// in another space than that of the BVH.
+	template<typename NodeDistance, typename Test>
+	void TraverseNearest(
+		PhysicsScalar& distance,
+		NodeDistance nodeDistance,
+		Test test) const
+	{
+		if (_nodes.empty()) {
+			return;
+		}
+
+		uint32_t stack[MaxDepth];
+		PhysicsScalar stackDistances[MaxDepth];
+		uint32_t stackSize = 0;
+
+		stack[stackSize] = 0;
+		stackDistances[stackSize] =
+			nodeDistance(_nodes[0].Min, _nodes[0].Max);
+		++stackSize;
+
+		while (stackSize > 0) {
+			--stackSize;
+			uint32_t current = stack[stackSize];
+
+			if (!(stackDistances[stackSize] <= distance)) {
+				continue;
+			}
+
+			const Node& node = _nodes[current];
+
+			if (node.Count > 0) {
+				for (uint32_t i = 0; i < node.Count; ++i) {
+					const TrianglePacket& packet =
+						_packets[node.Offset + i];
+					test(packet, distance);
+				}
+
+				continue;
+			}
+
+			uint32_t first = current + 1;
+			uint32_t second = node.Offset;
+
+			PhysicsScalar firstDistance = nodeDistance(
+				_nodes[first].Min,
+				_nodes[first].Max);
+			PhysicsScalar secondDistance = nodeDistance(
+				_nodes[second].Min,
+				_nodes[second].Max);
+
+			// The nearer child is pushed last to be visited first.
+			if (firstDistance < secondDistance) {
+				std::swap(first, second);
+				std::swap(firstDistance, secondDistance);
+			}
+
+			stack[stackSize] = first;
+			stackDistances[stackSize] = firstDistance;
+			++stackSize;
+			stack[stackSize] = second;
+			stackDistances[stackSize] = secondDistance;
+			++stackSize;
+		}
+	}
+
+private:
+	static const uint32_t MaxDepth = 64;
+	static const uint32_t MaxLeafSize = TrianglePacket::Width;
+	static const uint32_t BinCount = 12;
+
+	std::vector<Node> _nodes;
+	std::vector<TrianglePacket> _packets;
+
+	static PhysicsScalar GetBoxDistance(
+		const PhysicsVec3& min,
+		const PhysicsVec3& max,
+		const PhysicsVec3& point)
+	{
+		PhysicsScalar distanceSq = 0;
+
+		for (int i = 0; i < 3; ++i) {
+			PhysicsScalar outside = 0;
+
+			if (point[i] < min[i]) {
+				outside = min[i] - point[i];
+			} else if (point[i] > max[i]) {
+				outside = point[i] - max[i];
+			}
+
+			distanceSq += outside * outside;
+		}
+
+		return sqrt(distanceSq);
+	}
+
+	static bool IntersectNode(
+		const Node& node,
+		const PhysicsVec3& source,
+		const PhysicsVec3& invDir,
+		PhysicsScalar radius,
+		PhysicsScalar distance,
+		PhysicsScalar& entry)
+	{
+		PhysicsScalar tMin = 0;
+		PhysicsScalar tMax = distance;
+
+		for (int i = 0; i < 3; ++i) {
+			PhysicsScalar t1 =
+				(node.Min[i] - radius - source[i]) * invDir[i];
+			PhysicsScalar t2 =
+				(node.Max[i] + radius - source[i]) * invDir[i];
+
+			if (t1 > t2) {
+				std::swap(t1, t2);
+			}
+
+			tMin = t1 > tMin ? t1 : tMin;
+			tMax = t2 < tMax ? t2 : tMax;
+		}
+
+		entry = tMin;
+		return tMin <= tMax;
+	}
+
+	struct BuildTriangle
+	{
+		Math::Vec<3> Min;
+		Math::Vec<3> Max;
+		Math::Vec<3> Center;
+		uint32_t Index;
+	};
+
+	uint32_t BuildNode(
+		std::vector<BuildTriangle>& triangles,
+		uint32_t begin,
+		uint32_t end,
+		uint32_t depth);
+	void BuildPackets(
+		const std::vector<BuildTriangle>& triangles,
+		const std::vector<Math::Vec<3>>& vertices,
+		const std::vector<uint32_t>& indices);
+};
+
+#endif
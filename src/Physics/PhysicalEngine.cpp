@@ -1,533 +1,2522 @@
 #include "PhysicalEngine.h"
 
+#include <algorithm>
+
 #include "../Logger/logger.h"
+#include "Primitives.h"
+
+typedef PhysicalObject::PhysicalValues::ShapeType ShapeType;
 
 PhysicalEngine::PhysicalEngine()
 {
+	_sleepSpeed = 0.05;
+	_sleepTicks = 60;
+	_deterministic = false;
+
+	_statistics.AwakeSoftObjects = 0;
+	_statistics.SleepingSoftObjects = 0;
+	_statistics.FilteredPairs = 0;
+	_statistics.CollisionPairs = 0;
+	_statistics.MeshContacts = 0;
+	_statistics.CachedContacts = 0;
+
+	_meshContacts = 0;
+	_cachedContacts = 0;
+	_nextCacheId = 1;
 }
 
 PhysicalEngine::~PhysicalEngine()
 {
-	for (auto& desc : _objectDescriptors) {
-		delete desc.second;
+	ProcessCommands();
+
+	for (ObjectDescriptor& desc : _objectDescriptors.GetValues()) {
+		DeinitializeObject(desc);
 	}
 }
 
-void PhysicalEngine::RegisterObject(PhysicalObject* object)
+PhysicalEngine::ObjectHandle PhysicalEngine::RegisterObject(
+	PhysicalObject* object)
 {
-	_mutex.Lock();
-	InitializeObject(object);
-	_objects.insert(object);
-	_mutex.Unlock();
+	// Descriptors are built outside of the lock, so a large mesh
+	// does not stall a running step.
+	Command command;
+	command.Type = Command::CommandType::Register;
+	command.Descriptor = new ObjectDescriptor;
+	InitializeObject(object, *command.Descriptor);
+
+	_handleMutex.Lock();
+	command.Object = _objectDescriptors.Reserve();
+	_handleMutex.Unlock();
+
+	ObjectHandle handle = command.Object;
+	_commands.Push(std::move(command));
+
+	return handle;
 }
 
-void PhysicalEngine::RemoveObject(PhysicalObject* object)
+void PhysicalEngine::RemoveObject(ObjectHandle handle)
 {
-	_mutex.Lock();
-	_objects.erase(object);
-	DeinitializeObject(object);
-	_mutex.Unlock();
+	Command command;
+	command.Type = Command::CommandType::Remove;
+	command.Object = handle;
+
+	_commands.Push(std::move(command));
 }
 
-void PhysicalEngine::RegisterObject(SoftObject* object)
+PhysicalEngine::SoftObjectHandle PhysicalEngine::RegisterObject(
+	SoftObject* object)
 {
-	_mutex.Lock();
-	_softObjects.insert(object);
-	_mutex.Unlock();
+	Command command;
+	command.Type = Command::CommandType::RegisterSoft;
+	command.SoftDescriptor = new SoftObjectDescriptor;
+	command.SoftDescriptor->Object = object;
+	command.SoftDescriptor->Sleeping = false;
+	command.SoftDescriptor->QuietTicks = 0;
+	command.SoftDescriptor->LastForce =
+		object->SoftPhysicsParams.Force;
+	command.SoftDescriptor->Filter = {
+		object->SoftPhysicsParams.Category,
+		object->SoftPhysicsParams.Mask};
+
+	_handleMutex.Lock();
+	command.SoftObject = _softObjectDescriptors.Reserve();
+	_handleMutex.Unlock();
+
+	SoftObjectHandle handle = command.SoftObject;
+	_commands.Push(std::move(command));
+
+	return handle;
 }
 
-void PhysicalEngine::RemoveObject(SoftObject* object)
+void PhysicalEngine::RemoveObject(SoftObjectHandle handle)
 {
-	_mutex.Lock();
-	_softObjects.erase(object);
-	_mutex.Unlock();
+	Command command;
+	command.Type = Command::CommandType::RemoveSoft;
+	command.SoftObject = handle;
+
+	_commands.Push(std::move(command));
 }
 
-static void ToWorldSpace(
-	const Math::Mat<4>& transform,
-	const std::vector<Math::Vec<3>>& objectSpace,
-	std::vector<Math::Vec<3>>& worldSpace,
-	bool points)
+void PhysicalEngine::SetSleepParameters(double speed, uint32_t ticks)
 {
-	double w = points ? 1.0 : 0.0;
-
-	for (size_t i = 0; i < objectSpace.size(); ++i) {
-		worldSpace[i] = transform * Math::Vec<4>(objectSpace[i], w);
-	}
+	_lock.Lock();
+	_sleepSpeed = speed;
+	_sleepTicks = ticks;
+	_lock.Unlock();
 }
 
-void PhysicalEngine::UpdateObjectDescriptor(
-	PhysicalObject* object,
-	ObjectDescriptor& desc)
+void PhysicalEngine::SetDeterministic(bool deterministic)
 {
-	Math::Mat<4> transform = object->PhysicalParams.Matrix;
-	Math::Mat<4>* extMat = object->PhysicalParams.ExternalMatrix;
+	_lock.Lock();
+	_deterministic = deterministic;
+	_lock.Unlock();
+}
 
-	if (extMat) {
-		transform = *extMat * transform;
-	}
+void PhysicalEngine::WakeUp(SoftObjectHandle handle)
+{
+	Command command;
+	command.Type = Command::CommandType::WakeUp;
+	command.SoftObject = handle;
 
-	desc.Vertices.resize(object->PhysicalParams.Vertices.size());
-	desc.Normals.resize(object->PhysicalParams.Normals.size());
+	_commands.Push(std::move(command));
+}
 
-	ToWorldSpace(
-		transform,
-		object->PhysicalParams.Vertices,
-		desc.Vertices,
-		true);
+void PhysicalEngine::ProcessCommands()
+{
+	_handleMutex.Lock();
 
-	ToWorldSpace(
-		transform,
-		object->PhysicalParams.Normals,
-		desc.Normals,
-		false);
+	_commands.Drain(
+		[this](Command& command) -> void
+		{
+			ApplyCommand(command);
+		});
 
-	Math::Vec<3> center(0.0);
-	double radius = 0;
+	_handleMutex.Unlock();
+}
 
-	for (
-		size_t idx = 0;
-		idx < object->PhysicalParams.Vertices.size();
-		++idx)
+void PhysicalEngine::ApplyCommand(Command& command)
+{
+	switch (command.Type) {
+	case Command::CommandType::Register:
+		_objectDescriptors.Insert(
+			command.Object,
+			std::move(*command.Descriptor));
+		delete command.Descriptor;
+		break;
+	case Command::CommandType::Remove:
 	{
-		Math::Vec<3> vertex = desc.Vertices[idx];
-		center += vertex;
-	}
+		ObjectDescriptor* desc = _objectDescriptors.Get(command.Object);
 
-	center /= desc.Vertices.size();
+		if (desc) {
+			DeinitializeObject(*desc);
+		}
 
-	for (
-		size_t idx = 0;
-		idx < object->PhysicalParams.Vertices.size();
-		++idx)
+		_objectDescriptors.Remove(command.Object);
+		break;
+	}
+	case Command::CommandType::RegisterSoft:
+		_softObjectDescriptors.Insert(
+			command.SoftObject,
+			std::move(*command.SoftDescriptor));
+		delete command.SoftDescriptor;
+		break;
+	case Command::CommandType::RemoveSoft:
+		_softObjectDescriptors.Remove(command.SoftObject);
+		break;
+	case Command::CommandType::WakeUp:
 	{
-		Math::Vec<3> vertex = desc.Vertices[idx];
-		double dist = (vertex - center).Length();
+		SoftObjectDescriptor* desc =
+			_softObjectDescriptors.Get(command.SoftObject);
 
-		if (dist > radius) {
-			radius = dist;
+		if (desc) {
+			desc->Sleeping = false;
+			desc->QuietTicks = 0;
 		}
+
+		break;
+	}
 	}
+}
+
+PhysicalEngine::Statistics PhysicalEngine::GetStatistics()
+{
+	_lock.LockShared();
+	Statistics statistics = _statistics;
+	_lock.UnlockShared();
 
-	desc.Center = center;
-	desc.Radius = radius;
+	return statistics;
 }
 
-void PhysicalEngine::InitializeObject(PhysicalObject* object)
+static inline uint8_t* WriteBytes(
+	uint8_t* out,
+	const void* data,
+	size_t size)
 {
-	ObjectDescriptor* desc = new ObjectDescriptor;
-	UpdateObjectDescriptor(object, *desc);
-	_objectDescriptors[object] = desc;
+	memcpy(out, data, size);
+	return out + size;
 }
 
-void PhysicalEngine::DeinitializeObject(PhysicalObject* object)
+static inline const uint8_t* ReadBytes(
+	const uint8_t* in,
+	void* data,
+	size_t size)
 {
-	delete _objectDescriptors[object];
-	_objectDescriptors.erase(object);
+	memcpy(data, in, size);
+	return in + size;
 }
 
-void PhysicalEngine::Run(ThreadPool* threadPool, double timeStep)
+void PhysicalEngine::SaveSnapshot(std::vector<uint8_t>& snapshot)
 {
-	_mutex.Lock();
+	_lock.LockShared();
+	_handleMutex.Lock();
 
-	for (PhysicalObject* object : _objects) {
-		if (!object->PhysicalParams.Enabled) {
-			continue;
-		}
+	auto& softDescs = _softObjectDescriptors.GetValues();
+	auto& descs = _objectDescriptors.GetValues();
 
-		if (object->PhysicalParams.Dynamic) {
-			UpdateObjectDescriptor(
-				object,
-				*_objectDescriptors[object]);
-		}
+	uint32_t softCount = softDescs.size();
+	uint32_t dynamicCount = 0;
+	size_t size = 2 * sizeof(uint32_t);
+
+	for (SoftObjectDescriptor& desc : softDescs) {
+		size +=
+			sizeof(SoftObjectState) +
+			3 * sizeof(PhysicsVec3) *
+			desc.Object->SoftPhysicsParams.Vertices.size();
 	}
 
-	for (
-		auto sObj = _softObjects.begin();
-		sObj != _softObjects.end();
-		++sObj)
-	{
-		SoftObject* softObject = *sObj;
+	for (ObjectDescriptor& desc : descs) {
+		if (desc.Object->PhysicalParams.Dynamic) {
+			++dynamicCount;
+		}
+	}
 
-		ApplyForces(softObject, timeStep);
+	size += dynamicCount *
+		(sizeof(ObjectHandle) + sizeof(Math::Mat<4>::Data));
+	snapshot.resize(size);
+
+	uint8_t* out = snapshot.data();
+	out = WriteBytes(out, &softCount, sizeof(softCount));
+	out = WriteBytes(out, &dynamicCount, sizeof(dynamicCount));
+
+	for (size_t idx = 0; idx < softDescs.size(); ++idx) {
+		SoftObjectDescriptor& desc = softDescs[idx];
+		auto& params = desc.Object->SoftPhysicsParams;
+		auto& vertices = params.Vertices;
+		size_t columnSize = vertices.size() * sizeof(PhysicsVec3);
+
+		SoftObjectState state;
+		memset((void*)&state, 0, sizeof(state));
+		state.Force = params.Force;
+		state.LastForce = desc.LastForce;
+		state.SleepBounds = desc.SleepBounds;
+		state.Handle = _softObjectDescriptors.GetHandle(idx);
+		state.VertexCount = vertices.size();
+		state.QuietTicks = desc.QuietTicks;
+		state.Sleeping = desc.Sleeping;
+
+		out = WriteBytes(out, &state, sizeof(state));
+		out = WriteBytes(
+			out,
+			vertices.GetPositions().data(),
+			columnSize);
+		out = WriteBytes(out, vertices.GetSpeeds().data(), columnSize);
+		out = WriteBytes(out, vertices.GetForces().data(), columnSize);
+	}
 
-		for (
-			auto obj = _objects.begin();
-			obj != _objects.end();
-			++obj)
-		{
-			PhysicalObject* object = *obj;
+	for (size_t idx = 0; idx < descs.size(); ++idx) {
+		const auto& params = descs[idx].Object->PhysicalParams;
 
-			if (!object->PhysicalParams.Enabled) {
-				continue;
-			}
+		if (params.Dynamic) {
+			ObjectHandle handle = _objectDescriptors.GetHandle(idx);
 
-			threadPool->Enqueue(
-				[this, object, softObject, timeStep]() -> void
-				{
-					CalculateCollision(
-						object,
-						softObject,
-						timeStep);
-				});
+			out = WriteBytes(out, &handle, sizeof(handle));
+			out = WriteBytes(
+				out,
+				params.Matrix.Data,
+				sizeof(params.Matrix.Data));
 		}
 	}
 
-	threadPool->WaitAll();
+	_handleMutex.Unlock();
+	_lock.UnlockShared();
+}
 
-	for (SoftObject* object : _softObjects) {
-		threadPool->Enqueue(
-			[this, object, timeStep]() -> void
-			{
-				ApplyCollision(object, timeStep);
-			});
+// Each record must name a registered object by a live handle, and all
+// soft and dynamic objects must be recorded. Called with _handleMutex
+// held.
+bool PhysicalEngine::IsSnapshotValid(const std::vector<uint8_t>& snapshot)
+{
+	uint32_t counts[2];
+
+	if (snapshot.size() < sizeof(counts)) {
+		return false;
 	}
 
-	threadPool->WaitAll();
+	const uint8_t* in = ReadBytes(snapshot.data(), counts, sizeof(counts));
+	const uint8_t* end = snapshot.data() + snapshot.size();
 
-	_contacts.clear();
+	if (counts[0] != _softObjectDescriptors.GetValues().size()) {
+		return false;
+	}
 
-	_mutex.Unlock();
-}
+	for (uint32_t idx = 0; idx < counts[0]; ++idx) {
+		SoftObjectState state;
 
-static inline double determinant3(
-	const Math::Vec<3>& c0,
-	const Math::Vec<3>& c1,
-	const Math::Vec<3>& c2)
-{
-	return
-		c0[0] * c1[1] * c2[2] -
-		c0[0] * c1[2] * c2[1] -
-		c0[1] * c1[0] * c2[2] +
-		c0[1] * c1[2] * c2[0] +
-		c0[2] * c1[0] * c2[1] -
-		c0[2] * c1[1] * c2[0];
-}
+		if ((size_t)(end - in) < sizeof(state)) {
+			return false;
+		}
 
-static bool FindTriangleIntersection(
-	const Math::Vec<3>& source,
-	const Math::Vec<3>& direction,
-	const Math::Vec<3>& v1,
-	const Math::Vec<3>& v2,
-	const Math::Vec<3>& v3,
-	double& distance)
-{
-	const double EPSILON = 0.00000001;
+		in = ReadBytes(in, &state, sizeof(state));
 
-	Math::Vec<3> edge1 = v2 - v1;
-	Math::Vec<3> edge2 = v3 - v1;
+		SoftObjectDescriptor* desc =
+			_softObjectDescriptors.Get(state.Handle);
 
-	// u * edge1 + v * edge2 + v1 = source + t * direction
-	// u * edge1 + v * edge2 - t * direction = source - v1
+		if (!desc) {
+			return false;
+		}
 
-	// b = source - v1
-	// u * edge1 + v * edge2 - t * direction = b
+		auto& vertices = desc->Object->SoftPhysicsParams.Vertices;
+		size_t columnsSize = 3 * vertices.size() * sizeof(PhysicsVec3);
 
-	double det = determinant3(edge1, edge2, -direction);
-	if (det > -EPSILON && det < EPSILON) {
-		return false;
+		bool matches =
+			state.VertexCount == vertices.size() &&
+			(size_t)(end - in) >= columnsSize;
+
+		if (!matches) {
+			return false;
+		}
+
+		in += columnsSize;
 	}
 
-	Math::Vec<3> b = source - v1;
+	uint32_t dynamicCount = 0;
 
-	double u = determinant3(b, edge2, -direction) / det;
-	if (u < 0 || u > 1) {
-		return false;
+	for (ObjectDescriptor& desc : _objectDescriptors.GetValues()) {
+		if (desc.Object->PhysicalParams.Dynamic) {
+			++dynamicCount;
+		}
 	}
 
-	double v = determinant3(edge1, b, -direction) / det;
-	if (v < 0 || u + v > 1) {
+	size_t recordSize = sizeof(ObjectHandle) + sizeof(Math::Mat<4>::Data);
+
+	if (counts[1] != dynamicCount ||
+		(size_t)(end - in) != dynamicCount * recordSize) {
 		return false;
 	}
 
-	double t = determinant3(edge1, edge2, b) / det;
-	if (t < 0 || t > distance) {
-		return false;
+	for (uint32_t idx = 0; idx < dynamicCount; ++idx) {
+		ObjectHandle handle;
+		ReadBytes(in, &handle, sizeof(handle));
+
+		ObjectDescriptor* desc = _objectDescriptors.Get(handle);
+
+		if (!desc || !desc->Object->PhysicalParams.Dynamic) {
+			return false;
+		}
+
+		in += recordSize;
 	}
 
-	distance = t;
 	return true;
 }
 
-static bool FindMeshIntersection(
-	const Math::Vec<3>& source,
-	const Math::Vec<3>& direction,
-	const std::vector<Math::Vec<3>>& vertices,
-	const std::vector<Math::Vec<3>>& normals,
-	const std::vector<uint32_t>& indices,
-	double& distance,
-	Math::Vec<3>& outNormal)
+bool PhysicalEngine::RestoreSnapshot(const std::vector<uint8_t>& snapshot)
 {
-	bool intersection = false;
+	_lock.Lock();
+	_handleMutex.Lock();
+
+	if (!IsSnapshotValid(snapshot)) {
+		_handleMutex.Unlock();
+		_lock.Unlock();
+		Logger::Error() <<
+			"Snapshot does not match the registered objects.";
+		return false;
+	}
 
-	for (size_t index = 0; index < indices.size(); index += 3) {
-		double dist = distance;
+	uint32_t counts[2];
+	const uint8_t* in = ReadBytes(snapshot.data(), counts, sizeof(counts));
 
-		uint32_t index1 = indices[index];
-		uint32_t index2 = indices[index + 1];
-		uint32_t index3 = indices[index + 2];
+	for (uint32_t idx = 0; idx < counts[0]; ++idx) {
+		SoftObjectState state;
+		in = ReadBytes(in, &state, sizeof(state));
 
-		Math::Vec<3> normal =
-			normals[index1] +
-			normals[index2] +
-			normals[index3];
+		SoftObjectDescriptor& desc =
+			*_softObjectDescriptors.Get(state.Handle);
+		auto& params = desc.Object->SoftPhysicsParams;
+		auto& vertices = params.Vertices;
+		size_t columnSize = vertices.size() * sizeof(PhysicsVec3);
 
-		normal = normal.Normalize();
+		params.Force = state.Force;
+		desc.LastForce = state.LastForce;
+		desc.SleepBounds = state.SleepBounds;
+		desc.QuietTicks = state.QuietTicks;
+		desc.Sleeping = state.Sleeping;
 
-		double dot = direction.Dot(normal);
-		if (dot > 0) {
-			continue;
-		}
+		in = ReadBytes(in, vertices.GetPositions().data(), columnSize);
+		in = ReadBytes(in, vertices.GetSpeeds().data(), columnSize);
+		in = ReadBytes(in, vertices.GetForces().data(), columnSize);
 
-		bool intersect = FindTriangleIntersection(
-			source,
-			direction,
-			vertices[index1],
-			vertices[index2],
-			vertices[index3],
-			dist);
+		auto& cache = desc.ContactCache;
+		std::fill(cache.begin(), cache.end(), 0);
+	}
 
-		if (intersect && dist < distance) {
-			distance = dist;
-			outNormal = normal;
-			intersection = true;
-		}
+	for (uint32_t idx = 0; idx < counts[1]; ++idx) {
+		ObjectHandle handle;
+		in = ReadBytes(in, &handle, sizeof(handle));
+
+		ObjectDescriptor* desc = _objectDescriptors.Get(handle);
+		auto& matrix = desc->Object->PhysicalParams.Matrix;
+		in = ReadBytes(in, matrix.Data, sizeof(matrix.Data));
 	}
 
-	return intersection;
+	_handleMutex.Unlock();
+	_lock.Unlock();
+
+	return true;
 }
 
-void PhysicalEngine::CalculateCollision(
-	PhysicalObject* object,
-	SoftObject* softObject,
-	double timeStep)
+// Normals go to world space by the inverse transpose.
+static Math::Vec<3> ToWorldNormal(
+	const Math::Mat<4>& inverseTransform,
+	const Math::Vec<3>& normal)
 {
-	size_t vertexIndex = 0;
-	for (auto& vertex : softObject->SoftPhysicsParams.Vertices) {
-		ObjectDescriptor& desc = *_objectDescriptors[object];
+	Math::Vec<3> worldNormal;
 
-		bool possibleCollision =
-			(vertex.Position - desc.Center).Length() <=
-			desc.Radius + (vertex.Speed).Length() * 2.0;
+	for (int i = 0; i < 3; ++i) {
+		worldNormal[i] = 0;
 
-		if (!possibleCollision) {
-			continue;
+		for (int j = 0; j < 3; ++j) {
+			worldNormal[i] += inverseTransform[j][i] * normal[j];
 		}
+	}
+
+	return worldNormal.Normalize();
+}
+
+static void ToWorldSpace(
+	const Math::Mat<4>& transform,
+	const std::vector<Math::Vec<3>>& objectSpace,
+	std::vector<Math::Vec<3>>& worldSpace,
+	bool points)
+{
+	double w = points ? 1.0 : 0.0;
 
-		double distance = vertex.Speed.Length() *
-			timeStep * 1.01;
+	for (size_t i = 0; i < objectSpace.size(); ++i) {
+		worldSpace[i] = transform * Math::Vec<4>(objectSpace[i], w);
+	}
+}
 
-		if (distance < 0.01) {
-			distance = 0.01;
+static Broadphase::Box GetBounds(const std::vector<Math::Vec<3>>& vertices)
+{
+	Broadphase::Box bounds;
+	bounds.Min = Math::Vec<3>(INFINITY);
+	bounds.Max = Math::Vec<3>(-INFINITY);
+
+	for (const Math::Vec<3>& vertex : vertices) {
+		for (int i = 0; i < 3; ++i) {
+			bounds.Min[i] = std::min(bounds.Min[i], vertex[i]);
+			bounds.Max[i] = std::max(bounds.Max[i], vertex[i]);
 		}
+	}
 
-		Math::Vec<3> normal;
+	return bounds;
+}
 
-		bool intersect = FindMeshIntersection(
-			vertex.Position,
-			vertex.Speed.Normalize(),
-			desc.Vertices,
-			desc.Normals,
-			object->PhysicalParams.Indices,
-			distance,
-			normal);
+static Math::Mat<4> GetObjectTransform(PhysicalObject* object)
+{
+	Math::Mat<4> transform = object->PhysicalParams.Matrix;
+	Math::Mat<4>* extMat = object->PhysicalParams.ExternalMatrix;
 
-		if (intersect) {
-			Contact contact;
-			contact.Normal = normal;
-			contact.NormalDistance = distance *
-				fabs(normal.Dot(vertex.Speed.Normalize()));
-			contact.VertexIndex = vertexIndex;
-			contact.Mu = object->PhysicalParams.Mu;
-			contact.Bounciness =
-				object->PhysicalParams.Bounciness;
+	if (extMat) {
+		transform = *extMat * transform;
+	}
 
-			_effectMutex.Lock();
+	return transform;
+}
 
-			if (
-				_contacts.find(softObject) ==
-				_contacts.end())
-			{
-				_contacts[softObject] =
-					std::vector<Contact>();
-			}
+bool PhysicalEngine::IsTransformChanged(
+	PhysicalObject* object,
+	const ObjectDescriptor& desc)
+{
+	Math::Mat<4> transform = GetObjectTransform(object);
 
-			_contacts[softObject].push_back(contact);
-			_effectMutex.Unlock();
-		}
+	return memcmp(
+		transform.Data,
+		desc.Transform.Data,
+		sizeof(transform.Data));
+}
 
-		++vertexIndex;
-	}
+void PhysicalEngine::UpdateObjectDescriptor(
+	PhysicalObject* object,
+	ObjectDescriptor& desc)
+{
+	Math::Mat<4> transform = GetObjectTransform(object);
+	desc.Transform = transform;
+	desc.CacheId = _nextCacheId.fetch_add(
+		1,
+		std::memory_order_relaxed);
+
+	UpdateLocalDescriptor(object, desc);
 }
 
-void PhysicalEngine::ApplyForces(SoftObject* object, double timeStep)
+void PhysicalEngine::UpdateLocalDescriptor(
+	PhysicalObject* object,
+	ObjectDescriptor& desc)
 {
-	auto& vertices = object->SoftPhysicsParams.Vertices;
-	auto& links = object->SoftPhysicsParams.Links;
-	std::vector<Math::Vec<3>> forces(vertices.size());
+	const auto& params = object->PhysicalParams;
+	const Math::Mat<4>& transform = desc.Transform;
 
-	for (size_t idx = 0; idx < vertices.size(); ++idx) {
-		forces[idx] = vertices[idx].Force +
-			object->SoftPhysicsParams.Force;
+	desc.InverseTransform = transform.Inverse();
+
+	if (params.Shape == ShapeType::Plane) {
+		desc.Center = transform * Math::Vec<4>({0.0, 0.0, 0.0, 1.0});
+		desc.Radius = INFINITY;
+		desc.Bounds.Min = Math::Vec<3>(-INFINITY);
+		desc.Bounds.Max = Math::Vec<3>(INFINITY);
+		return;
 	}
 
-	for (auto& link : links) {
-		Math::Vec<3> delta =
-			vertices[link.Index1].Position -
-			vertices[link.Index2].Position;
+	Math::Vec<3> min;
+	Math::Vec<3> max;
+
+	switch (params.Shape) {
+	case ShapeType::Mesh:
+		min = desc.Mesh ? desc.Mesh->GetMin() : desc.LocalBounds.Min;
+		max = desc.Mesh ? desc.Mesh->GetMax() : desc.LocalBounds.Max;
+		break;
+	case ShapeType::Sphere:
+		max = Math::Vec<3>(params.Radius);
+		min = -max;
+		break;
+	case ShapeType::Box:
+		max = params.HalfExtents;
+		min = -max;
+		break;
+	case ShapeType::Capsule:
+		max = Math::Vec<3>({
+			params.Radius,
+			params.Radius,
+			params.HalfHeight + params.Radius});
+		min = -max;
+		break;
+	default:
+		min = desc.Field.GetMin();
+		max = desc.Field.GetMax();
+		break;
+	}
 
-		Math::Vec<3> normDelta = delta.Normalize();
+	// Bounds of the transformed local box around the shape.
+	desc.Bounds.Min = Math::Vec<3>(INFINITY);
+	desc.Bounds.Max = Math::Vec<3>(-INFINITY);
+
+	for (int corner = 0; corner < 8; ++corner) {
+		Math::Vec<4> local({
+			corner & 1 ? max[0] : min[0],
+			corner & 2 ? max[1] : min[1],
+			corner & 4 ? max[2] : min[2],
+			1.0});
+		Math::Vec<3> vertex = transform * local;
+
+		for (int i = 0; i < 3; ++i) {
+			desc.Bounds.Min[i] = std::min(
+				desc.Bounds.Min[i],
+				vertex[i]);
+			desc.Bounds.Max[i] = std::max(
+				desc.Bounds.Max[i],
+				vertex[i]);
+		}
+	}
 
-		double deltaL = delta.Length() - link.Length;
-		Math::Vec<3> force = normDelta * link.K * deltaL;
+	desc.Center = (desc.Bounds.Min + desc.Bounds.Max) / 2.0;
+	desc.Radius = (desc.Bounds.Max - desc.Center).Length();
+}
 
-		Math::Vec<3> deltaV =
-			vertices[link.Index1].Speed -
-			vertices[link.Index2].Speed;
+void PhysicalEngine::InitializeObject(
+	PhysicalObject* object,
+	ObjectDescriptor& desc)
+{
+	desc.Object = object;
+	desc.Mesh = nullptr;
+	desc.Filter = {
+		object->PhysicalParams.Category,
+		object->PhysicalParams.Mask};
+
+	if (object->PhysicalParams.Shape == ShapeType::Mesh) {
+		desc.Mesh = object->PhysicalParams.Mesh;
+	}
 
-		deltaV = normDelta * normDelta.Dot(deltaV);
+	if (desc.Mesh) {
+		desc.Mesh->IncRef();
+	}
 
-		if (deltaV.Dot(delta) > 0) {
-			// Link length increasing.
-			force += normDelta *
-				deltaV.Length() * link.Friction;
-		} else if (deltaV.Dot(delta) < 0) {
-			// Link length decreasing.
-			force -= normDelta *
-				deltaV.Length() * link.Friction;
-		}
+	if (object->PhysicalParams.Shape == ShapeType::Heightfield) {
+		desc.Field.Build(
+			std::move(object->PhysicalParams.Heights),
+			object->PhysicalParams.HeightsWidth,
+			object->PhysicalParams.HeightsDepth,
+			object->PhysicalParams.CellSize);
+	}
 
-		forces[link.Index1] -= force;
-		forces[link.Index2] += force;
+	if (object->PhysicalParams.Shape != ShapeType::Mesh || desc.Mesh) {
+		UpdateObjectDescriptor(object, desc);
+		return;
 	}
 
-	size_t vertexIndex = 0;
-	for (auto& vertex : vertices) {
-		vertex.Speed += forces[vertexIndex] / vertex.Mass * timeStep;
-		++vertexIndex;
+	auto& vertices = object->PhysicalParams.Vertices;
+	auto& normals = object->PhysicalParams.Normals;
+	auto& indices = object->PhysicalParams.Indices;
+
+	desc.FaceNormals.resize(indices.size() / 3);
+
+	for (size_t idx = 0; idx < desc.FaceNormals.size(); ++idx) {
+		Math::Vec<3> normal =
+			normals[indices[idx * 3]] +
+			normals[indices[idx * 3 + 1]] +
+			normals[indices[idx * 3 + 2]];
+		desc.FaceNormals[idx] = normal.Normalize();
 	}
-}
 
-void PhysicalEngine::ApplyCollision(SoftObject* object, double timeStep)
-{
-	auto& vertices = object->SoftPhysicsParams.Vertices;
-	std::vector<Math::Vec<3>> forces(vertices.size());
+	desc.LocalBounds = GetBounds(vertices);
+	UpdateObjectDescriptor(object, desc);
 
-	for (size_t idx = 0; idx < vertices.size(); ++idx) {
-		forces[idx] = Math::Vec<3>(0.0);
+	if (object->PhysicalParams.Dynamic) {
+		desc.BVH.Build(vertices, indices);
+		return;
 	}
 
-	double minDist = 0.005;
+	// Static meshes are queried in world space. The world vertices
+	// are only needed for the BVH and tighter bounds than those of
+	// the transformed local box.
+	std::vector<Math::Vec<3>> worldVertices(vertices.size());
+	ToWorldSpace(desc.Transform, vertices, worldVertices, true);
 
-	for (auto& contact : _contacts[object]) {
-		size_t vertexIndex = contact.VertexIndex;
-		auto& vertex = vertices[vertexIndex];
+	desc.BVH.Build(worldVertices, indices);
+	desc.Bounds = GetBounds(worldVertices);
+	desc.Center = (desc.Bounds.Min + desc.Bounds.Max) / 2.0;
+	desc.Radius = (desc.Bounds.Max - desc.Center).Length();
 
-		Math::Vec<3> normalSpeed = contact.Normal *
-			contact.Normal.Dot(vertex.Speed);
-		Math::Vec<3> tangentSpeed = vertex.Speed - normalSpeed;
+	for (PhysicsVec3& normal : desc.FaceNormals) {
+		normal = ToWorldNormal(desc.InverseTransform, normal);
+	}
+}
+
+void PhysicalEngine::DeinitializeObject(ObjectDescriptor& desc)
+{
+	if (desc.Mesh) {
+		desc.Mesh->DecRef();
+		desc.Mesh = nullptr;
+	}
+}
 
-		double normalSurfaceDist = contact.NormalDistance;
+void PhysicalEngine::Run(ThreadPool* threadPool, double timeStep)
+{
+	_lock.Lock();
 
-		if (normalSurfaceDist < minDist) {
-			vertex.Position += contact.Normal *
-				(minDist - normalSurfaceDist);
-		}
+	ProcessCommands();
 
-		Math::Vec<3> targetSpeed = contact.Normal *
-			normalSpeed.Length() *
-			(vertex.Bounciness + contact.Bounciness) / 2.0;
+	_pairObjects.clear();
+	_pairObjectDescriptors.clear();
+	_pairObjectBounds.clear();
+	_pairObjectFilters.clear();
+	_movedDescriptors.clear();
+	_movedBounds.clear();
+	_movedFilters.clear();
 
-		Math::Vec<3> normalResponse =
-			(targetSpeed - normalSpeed) * vertex.Mass / timeStep;
+	for (ObjectDescriptor& objectDesc : _objectDescriptors.GetValues()) {
+		PhysicalObject* object = objectDesc.Object;
+		ObjectDescriptor* desc = &objectDesc;
 
-		double mu = std::min(vertex.Mu, contact.Mu);
+		if (!object->PhysicalParams.Enabled) {
+			continue;
+		}
 
-		Math::Vec<3> tangentResponse(0.0);
-		double frictionLimit = mu * normalResponse.Length();
+		desc->Filter = {
+			object->PhysicalParams.Category,
+			object->PhysicalParams.Mask};
 
-		if (tangentSpeed.Length() > 0.00001) {
-			double maxTangentForce = tangentSpeed.Length() *
-				vertex.Mass / timeStep;
+		bool update =
+			object->PhysicalParams.Dynamic &&
+			IsTransformChanged(object, *desc);
 
-			tangentResponse =
-				tangentSpeed.Normalize() * -frictionLimit;
+		if (update) {
+			_movedDescriptors.push_back(desc);
+			_movedBounds.push_back(desc->Bounds);
+			_movedFilters.push_back(desc->Filter);
 
-			if (tangentResponse.Length() > maxTangentForce) {
-				tangentResponse =
-					tangentResponse.Normalize() *
-					maxTangentForce;
-			}
+			threadPool->Enqueue(
+				[this, object, desc]() -> void
+				{
+					UpdateObjectDescriptor(object, *desc);
+				});
 		}
 
-		forces[vertexIndex] += normalResponse + tangentResponse;
+		_pairObjects.push_back(object);
+		_pairObjectDescriptors.push_back(desc);
 	}
 
-	size_t vertexIndex = 0;
-	for (auto& vertex : vertices) {
-		vertex.Speed += forces[vertexIndex] / vertex.Mass * timeStep;
-		vertex.Position += vertex.Speed * timeStep;
+	threadPool->WaitAll();
 
-		++vertexIndex;
+	for (ObjectDescriptor* desc : _pairObjectDescriptors) {
+		_pairObjectBounds.push_back(desc->Bounds);
+		_pairObjectFilters.push_back(desc->Filter);
 	}
-}
 
-PhysicalEngine::RayCastResult PhysicalEngine::RayCast(
-	const Math::Vec<3>& point,
-	const Math::Vec<3>& direction,
-	double distance,
-	void* userPointer,
-	std::set<PhysicalObject*> ignore)
-{
-	_mutex.Lock();
+	_queryBroadphase.Index(_pairObjectBounds);
+
+	for (size_t idx = 0; idx < _movedDescriptors.size(); ++idx) {
+		const Broadphase::Box& bounds = _movedDescriptors[idx]->Bounds;
 
-	PhysicalObject* closestObject = nullptr;
+		for (int i = 0; i < 3; ++i) {
+			_movedBounds[idx].Min[i] = std::min(
+				_movedBounds[idx].Min[i],
+				bounds.Min[i]);
+			_movedBounds[idx].Max[i] = std::max(
+				_movedBounds[idx].Max[i],
+				bounds.Max[i]);
+		}
+	}
 
-	for (PhysicalObject* object : _objects) {
-		if (ignore.find(object) != ignore.end()) {
+	_awakeSoftObjects.clear();
+	_awakeSoftDescriptors.clear();
+	_statistics.SleepingSoftObjects = 0;
+	_statistics.FilteredPairs = 0;
+	_statistics.CollisionPairs = 0;
+	_meshContacts = 0;
+	_cachedContacts = 0;
+
+	for (auto& softDesc : _softObjectDescriptors.GetValues()) {
+		SoftObject* softObject = softDesc.Object;
+		SoftObjectDescriptor* desc = &softDesc;
+
+		desc->Filter = {
+			softObject->SoftPhysicsParams.Category,
+			softObject->SoftPhysicsParams.Mask};
+
+		if (!IsSoftObjectAwake(softObject, *desc)) {
+			desc->InPass = false;
+			++_statistics.SleepingSoftObjects;
 			continue;
 		}
 
-		ObjectDescriptor& desc = *_objectDescriptors[object];
+		_awakeSoftObjects.push_back(softObject);
+		_awakeSoftDescriptors.push_back(desc);
 
-		bool possibleCollision =
-			(point - desc.Center).Length() <=
-			desc.Radius + direction.Length() * distance;
+		auto& vertices = softObject->SoftPhysicsParams.Vertices;
 
-		if (!possibleCollision) {
-			continue;
+		if (desc->ContactCache.size() != vertices.size()) {
+			desc->ContactCache.assign(vertices.size(), 0);
 		}
 
-		Math::Vec<3> normal;
-		double dist = distance;
+		threadPool->Enqueue(
+			[desc, softObject, timeStep]() -> void
+			{
+				desc->Substeps = desc->Links.EstimateSubsteps(
+					softObject,
+					timeStep);
+				desc->Step = timeStep / desc->Substeps;
+			});
+	}
 
-		bool intersect = FindMeshIntersection(
-			point,
-			direction,
-			desc.Vertices,
-			desc.Normals,
-			object->PhysicalParams.Indices,
-			dist,
-			normal);
+	_statistics.AwakeSoftObjects = _awakeSoftObjects.size();
 
-		if (intersect) {
-			if (dist < distance) {
-				distance = dist;
-				closestObject = object;
-			}
-		}
+	threadPool->WaitAll();
+
+	// Every soft object runs its own number of substeps of the
+	// whole step, stiff ones take part in more of the passes.
+	uint32_t substeps = 1;
+
+	for (SoftObjectDescriptor* desc : _awakeSoftDescriptors) {
+		substeps = std::max(substeps, desc->Substeps);
 	}
 
-	_mutex.Unlock();
+	for (uint32_t substep = 0; substep < substeps; ++substep) {
+		RunSubstep(threadPool, substep);
+	}
 
-	RayCastResult res;
-	res.object = closestObject;
+	_statistics.MeshContacts = _meshContacts;
+	_statistics.CachedContacts = _cachedContacts;
 
-	if (closestObject) {
-		res.Code = closestObject->RayCastCallback(userPointer);
-	} else {
-		res.Code = 0;
+	_lock.Unlock();
+}
+
+void PhysicalEngine::RunSubstep(ThreadPool* threadPool, uint32_t substep)
+{
+	_pairSoftObjects.clear();
+	_pairSoftDescriptors.clear();
+
+	for (size_t idx = 0; idx < _awakeSoftObjects.size(); ++idx) {
+		SoftObjectDescriptor* desc = _awakeSoftDescriptors[idx];
+		desc->InPass = desc->Substeps > substep;
+
+		if (desc->InPass) {
+			_pairSoftObjects.push_back(_awakeSoftObjects[idx]);
+			_pairSoftDescriptors.push_back(desc);
+		}
+	}
+
+	for (size_t idx = 0; idx < _pairSoftObjects.size(); ++idx) {
+		SoftObject* softObject = _pairSoftObjects[idx];
+		SoftObjectDescriptor* desc = _pairSoftDescriptors[idx];
+
+		if (
+			softObject->SoftPhysicsParams.Links.size() <
+			ParallelLinkThreshold)
+		{
+			threadPool->Enqueue(
+				[desc, softObject]() -> void
+				{
+					desc->Links.ApplyForces(
+						softObject,
+						nullptr,
+						desc->Step);
+				});
+		} else {
+			desc->Links.ApplyForces(
+				softObject,
+				threadPool,
+				desc->Step);
+		}
+	}
+
+	threadPool->WaitAll();
+
+	CollideSoftObjects(threadPool);
+
+	_pairSoftBounds.clear();
+	_pairSoftFilters.clear();
+
+	for (size_t idx = 0; idx < _pairSoftObjects.size(); ++idx) {
+		_pairSoftBounds.push_back(
+			GetSoftObjectBounds(
+				_pairSoftObjects[idx],
+				_pairSoftDescriptors[idx]->Step));
+		_pairSoftFilters.push_back(_pairSoftDescriptors[idx]->Filter);
+	}
+
+	_statistics.FilteredPairs += _broadphase.FindPairs(
+		_pairSoftBounds,
+		_pairSoftFilters,
+		_pairObjectBounds,
+		_pairObjectFilters,
+		_pairs);
+	_statistics.CollisionPairs += _pairs.size();
+
+	_contactArenas.resize(threadPool->GetThreadCount() + 1);
+
+	// Pairs differ a lot in cost, so chunks are single pairs, taken
+	// by whichever thread is free.
+	threadPool->ParallelFor(
+		_pairs.size(),
+		1,
+		[this, threadPool](size_t begin, size_t end) -> void
+		{
+			uint32_t worker = threadPool->GetWorkerIndex();
+
+			for (size_t idx = begin; idx < end; ++idx) {
+				const Broadphase::Pair& pair = _pairs[idx];
+
+				CalculateCollision(
+					_pairObjects[pair.Second],
+					pair.Second,
+					*_pairObjectDescriptors[pair.Second],
+					_pairSoftObjects[pair.First],
+					pair.First,
+					_contactArenas[worker],
+					_pairSoftDescriptors[pair.First]->Step);
+			}
+		});
+
+	MergeContacts();
+
+	for (
+		uint32_t softObjectIndex = 0;
+		softObjectIndex < _pairSoftObjects.size();
+		++softObjectIndex)
+	{
+		bool lastSubstep =
+			_pairSoftDescriptors[softObjectIndex]->Substeps ==
+			substep + 1;
+
+		threadPool->Enqueue(
+			[this, softObjectIndex, lastSubstep]() -> void
+			{
+				ApplyCollision(softObjectIndex, lastSubstep);
+			});
+	}
+
+	threadPool->WaitAll();
+}
+
+void PhysicalEngine::MergeContacts()
+{
+	size_t softObjectCount = _pairSoftObjects.size();
+
+	_contactOffsets.assign(softObjectCount + 1, 0);
+
+	for (auto& arena : _contactArenas) {
+		for (const Contact& contact : arena) {
+			++_contactOffsets[contact.SoftObjectIndex + 1];
+		}
+	}
+
+	for (size_t idx = 0; idx < softObjectCount; ++idx) {
+		_contactOffsets[idx + 1] += _contactOffsets[idx];
+	}
+
+	_contacts.resize(_contactOffsets[softObjectCount]);
+	_contactCursors.assign(
+		_contactOffsets.begin(),
+		_contactOffsets.end() - 1);
+
+	for (auto& arena : _contactArenas) {
+		for (const Contact& contact : arena) {
+			size_t& cursor =
+				_contactCursors[contact.SoftObjectIndex];
+
+			_contacts[cursor] = contact;
+			++cursor;
+		}
+
+		arena.clear();
+	}
+}
+
+void PhysicalEngine::CollideSoftObjects(ThreadPool* threadPool)
+{
+	_softColliders.clear();
+	_softColliderDescriptors.clear();
+
+	for (size_t idx = 0; idx < _pairSoftObjects.size(); ++idx) {
+		if (_pairSoftObjects[idx]->SoftPhysicsParams.SoftCollision) {
+			_softColliders.push_back(_pairSoftObjects[idx]);
+			_softColliderDescriptors.push_back(
+				_pairSoftDescriptors[idx]);
+		}
+	}
+
+	size_t movingColliders = _softColliders.size();
+
+	if (movingColliders == 0) {
+		return;
+	}
+
+	for (auto& desc : _softObjectDescriptors.GetValues()) {
+		bool obstacle =
+			desc.Object->SoftPhysicsParams.SoftCollision &&
+			!desc.InPass;
+
+		if (obstacle) {
+			_softColliders.push_back(desc.Object);
+			_softColliderDescriptors.push_back(&desc);
+		}
+	}
+
+	_softPoints.clear();
+	_softPointPositions.clear();
+	_softPointSpeeds.clear();
+
+	PhysicsScalar cellSize = 0;
+
+	for (
+		uint32_t collider = 0;
+		collider < _softColliders.size();
+		++collider)
+	{
+		auto& params = _softColliders[collider]->SoftPhysicsParams;
+		auto& vertices = params.Vertices;
+		auto& positions = vertices.GetPositions();
+		auto& speeds = vertices.GetSpeeds();
+		auto& inverseMasses = vertices.GetInverseMasses();
+
+		PhysicsScalar radius = params.CollisionRadius;
+		cellSize = std::max<PhysicsScalar>(cellSize, radius * 2);
+
+		for (uint32_t idx = 0; idx < vertices.size(); ++idx) {
+			_softPoints.push_back(
+				{collider, idx, inverseMasses[idx], radius});
+			_softPointPositions.push_back(positions[idx]);
+			_softPointSpeeds.push_back(speeds[idx]);
+		}
+
+		if (collider + 1 == movingColliders) {
+			_movingSoftPoints = _softPoints.size();
+		}
+	}
+
+	if (!(cellSize > 0)) {
+		return;
+	}
+
+	_softHash.Build(threadPool, _softPointPositions, cellSize);
+
+	_softPointPositionDeltas.resize(_movingSoftPoints);
+	_softPointSpeedDeltas.resize(_movingSoftPoints);
+
+	const size_t chunkSize = 1024;
+
+	threadPool->ParallelFor(
+		_movingSoftPoints,
+		chunkSize,
+		[this](size_t begin, size_t end) -> void
+		{
+			for (size_t point = begin; point < end; ++point) {
+				FindSoftContacts(point);
+			}
+		});
+
+	threadPool->ParallelFor(
+		_movingSoftPoints,
+		chunkSize,
+		[this](size_t begin, size_t end) -> void
+		{
+			for (size_t point = begin; point < end; ++point) {
+				const SoftPoint& softPoint = _softPoints[point];
+				SoftObject* object =
+					_softColliders[softPoint.Collider];
+				auto& vertices =
+					object->SoftPhysicsParams.Vertices;
+
+				vertices.GetPositions()[softPoint.Vertex] +=
+					_softPointPositionDeltas[point];
+				vertices.GetSpeeds()[softPoint.Vertex] +=
+					_softPointSpeedDeltas[point];
+			}
+		});
+}
+
+void PhysicalEngine::FindSoftContacts(size_t point)
+{
+	const SoftPoint& softPoint = _softPoints[point];
+	const PhysicsVec3& position = _softPointPositions[point];
+	const PhysicsVec3& speed = _softPointSpeeds[point];
+
+	bool selfCollision = _softColliders[softPoint.Collider]->
+		SoftPhysicsParams.SelfCollision;
+	const SoftObjectDescriptor& desc =
+		*_softColliderDescriptors[softPoint.Collider];
+
+	PhysicsVec3 positionDelta(0.0);
+	PhysicsVec3 speedDelta(0.0);
+
+	// Every point only moves itself, by its inverse mass share of
+	// the separation; fixed obstacles take no share.
+	_softHash.Query(
+		position,
+		[&](uint32_t other) -> void
+		{
+			const SoftPoint& otherPoint = _softPoints[other];
+
+			if (otherPoint.Collider == softPoint.Collider) {
+				bool skip =
+					other == point ||
+					!selfCollision ||
+					desc.Links.AreLinked(
+						softPoint.Vertex,
+						otherPoint.Vertex);
+
+				if (skip) {
+					return;
+				}
+			} else {
+				const Broadphase::Filter& otherFilter =
+					_softColliderDescriptors[
+						otherPoint.Collider]->Filter;
+
+				if (!desc.Filter.Accepts(otherFilter)) {
+					return;
+				}
+			}
+
+			PhysicsScalar radius =
+				softPoint.Radius + otherPoint.Radius;
+			PhysicsVec3 delta =
+				position - _softPointPositions[other];
+			PhysicsScalar distanceSq = delta.Dot(delta);
+
+			if (!(distanceSq < radius * radius && distanceSq > 0)) {
+				return;
+			}
+
+			PhysicsScalar otherInverseMass =
+				other < _movingSoftPoints ?
+				otherPoint.InverseMass :
+				0;
+			PhysicsScalar totalInverseMass =
+				softPoint.InverseMass + otherInverseMass;
+
+			if (!(totalInverseMass > 0)) {
+				return;
+			}
+
+			PhysicsScalar share =
+				softPoint.InverseMass / totalInverseMass;
+			PhysicsScalar distance = sqrt(distanceSq);
+			PhysicsVec3 normal = delta / distance;
+
+			positionDelta += normal * ((radius - distance) * share);
+
+			PhysicsScalar approach =
+				normal.Dot(speed - _softPointSpeeds[other]);
+
+			if (approach < 0) {
+				speedDelta -= normal * (approach * share);
+			}
+		});
+
+	_softPointPositionDeltas[point] = positionDelta;
+	_softPointSpeedDeltas[point] = speedDelta;
+}
+
+static inline double GetSweepDistance(
+	const PhysicsVec3& speed,
+	double timeStep)
+{
+	double distance = speed.Length() * timeStep * 1.01;
+
+	if (distance < 0.01) {
+		distance = 0.01;
+	}
+
+	return distance;
+}
+
+// Radius of the spheres swept from the vertices, 0 for rays.
+static inline double GetSweepRadius(SoftObject* object)
+{
+	const auto& params = object->SoftPhysicsParams;
+
+	if (params.Sweep == SoftObject::SoftPhysicsValues::SweepType::Ray) {
+		return 0;
+	}
+
+	return params.SweepRadius;
+}
+
+Broadphase::Box PhysicalEngine::GetSoftObjectBounds(
+	SoftObject* object,
+	double timeStep)
+{
+	auto& vertices = object->SoftPhysicsParams.Vertices;
+	auto& positions = vertices.GetPositions();
+	auto& speeds = vertices.GetSpeeds();
+
+	// Vertices are swept no further than GetSweepDistance in any
+	// direction, so the box covers every possible contact.
+	Broadphase::Box bounds;
+	bounds.Min = Math::Vec<3>(INFINITY);
+	bounds.Max = Math::Vec<3>(-INFINITY);
+
+	double radius = GetSweepRadius(object);
+
+	for (size_t idx = 0; idx < vertices.size(); ++idx) {
+		double distance =
+			GetSweepDistance(speeds[idx], timeStep) + radius;
+
+		for (int i = 0; i < 3; ++i) {
+			bounds.Min[i] = std::min(
+				bounds.Min[i],
+				positions[idx][i] - distance);
+			bounds.Max[i] = std::max(
+				bounds.Max[i],
+				positions[idx][i] + distance);
+		}
+	}
+
+	return bounds;
+}
+
+static inline int NearestLane(
+	uint32_t mask,
+	const PhysicsScalar* distances)
+{
+	int lane = -1;
+
+	for (int i = 0; i < TrianglePacket::Width; ++i) {
+		if (!(mask & (1 << i))) {
+			continue;
+		}
+
+		if (lane < 0 || distances[i] < distances[lane]) {
+			lane = i;
+		}
+	}
+
+	return lane;
+}
+
+// Radius of a sphere that holds the transformed sphere of radius. The
+// transform stretches no vector by more than the spectral norm of its
+// 3x3 part, the square root of the largest eigenvalue of its Gram
+// matrix, which is exact for any linear part, the inverses of rotated
+// non-uniform scales included.
+static double ScaleRadius(
+	const Math::Mat<4>& transform,
+	double radius)
+{
+	double gram[3][3];
+
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			gram[i][j] = 0;
+
+			for (int k = 0; k < 3; ++k) {
+				gram[i][j] += transform[k][i] * transform[k][j];
+			}
+		}
+	}
+
+	// Closed form eigenvalues of a symmetric 3x3 matrix, from the
+	// characteristic polynomial of (gram - mean) / spread.
+	double offDiagonal =
+		gram[0][1] * gram[0][1] +
+		gram[0][2] * gram[0][2] +
+		gram[1][2] * gram[1][2];
+	double mean = (gram[0][0] + gram[1][1] + gram[2][2]) / 3;
+	double deviation = 2 * offDiagonal;
+
+	for (int i = 0; i < 3; ++i) {
+		deviation += (gram[i][i] - mean) * (gram[i][i] - mean);
+	}
+
+	double spread = sqrt(deviation / 6);
+	double largest = mean;
+
+	if (spread > 0) {
+		double c[3][3];
+
+		for (int i = 0; i < 3; ++i) {
+			for (int j = 0; j < 3; ++j) {
+				c[i][j] = gram[i][j] / spread;
+			}
+
+			c[i][i] -= mean / spread;
+		}
+
+		double determinant =
+			c[0][0] * (c[1][1] * c[2][2] - c[1][2] * c[2][1]) -
+			c[0][1] * (c[1][0] * c[2][2] - c[1][2] * c[2][0]) +
+			c[0][2] * (c[1][0] * c[2][1] - c[1][1] * c[2][0]);
+		double phase = std::clamp(determinant / 2, -1.0, 1.0);
+
+		largest = mean + 2 * spread * cos(acos(phase) / 3);
+	}
+
+	return radius * sqrt(std::max(largest, 0.0));
+}
+
+// Sweeps a sphere of radius instead of the ray if radius is positive.
+// packetIndex is a packet to test before the traversal, or
+// UINT32_MAX. It is set to the packet of the hit.
+static bool FindMeshIntersection(
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	const Math::Vec<3>& worldDirection,
+	double radius,
+	const MeshBVH& bvh,
+	const std::vector<PhysicsVec3>& faceNormals,
+	double& distance,
+	Math::Vec<3>& outNormal,
+	uint32_t& outTriangle,
+	uint32_t& packetIndex)
+{
+	PhysicsVec3 packetSource = source;
+	PhysicsVec3 packetDirection = direction;
+	PhysicsVec3 normalDirection = worldDirection;
+	PhysicsScalar packetRadius = radius;
+	PhysicsScalar packetDistance = distance;
+
+	const std::vector<TrianglePacket>& packets = bvh.GetPackets();
+
+	auto test = [&](
+		const TrianglePacket& packet,
+		PhysicsScalar& distance) -> bool
+	{
+		PhysicsScalar distances[TrianglePacket::Width];
+		uint32_t mask;
+
+		if (packetRadius > 0) {
+			mask = SweepSpherePacket(
+				packet,
+				packetSource,
+				packetDirection,
+				packetRadius,
+				distance,
+				distances);
+		} else {
+			mask = IntersectTrianglePacket(
+				packet,
+				packetSource,
+				packetDirection,
+				distance,
+				distances);
+		}
+
+		// Take the nearest hit lane that is not facing away.
+		while (mask) {
+			int lane = NearestLane(mask, distances);
+			mask &= ~(1 << lane);
+
+			uint32_t triangle = packet.Triangles[lane];
+			auto& normal = faceNormals[triangle];
+
+			PhysicsScalar dot = normalDirection.Dot(normal);
+			if (dot > 0) {
+				continue;
+			}
+
+			if (distances[lane] < distance) {
+				distance = distances[lane];
+				outNormal = normal;
+				outTriangle = triangle;
+				packetIndex = &packet - packets.data();
+				return true;
+			}
+
+			return false;
+		}
+
+		return false;
+	};
+
+	// A hit in the given packet shortens the traversal to the
+	// nodes in front of it.
+	bool hit =
+		packetIndex < packets.size() &&
+		test(packets[packetIndex], packetDistance);
+
+	hit |= bvh.Traverse(
+		packetSource,
+		packetDirection,
+		packetRadius,
+		packetDistance,
+		test);
+
+	if (hit) {
+		distance = packetDistance;
+	}
+
+	return hit;
+}
+
+bool PhysicalEngine::FindObjectIntersection(
+	PhysicalObject* object,
+	const ObjectDescriptor& desc,
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double radius,
+	double& distance,
+	Math::Vec<3>& outNormal,
+	uint32_t& outTriangle,
+	uint32_t& packetIndex)
+{
+	if (object->PhysicalParams.Shape != ShapeType::Mesh || desc.Mesh) {
+		return FindLocalIntersection(
+			object,
+			desc,
+			source,
+			direction,
+			radius,
+			distance,
+			outNormal,
+			outTriangle,
+			packetIndex);
+	}
+
+	if (!object->PhysicalParams.Dynamic) {
+		return FindMeshIntersection(
+			source,
+			direction,
+			direction,
+			radius,
+			desc.BVH,
+			desc.FaceNormals,
+			distance,
+			outNormal,
+			outTriangle,
+			packetIndex);
+	}
+
+	// Distance along the ray is preserved by the affine transform
+	// as long as the direction is not renormalized.
+	Math::Vec<3> localSource =
+		desc.InverseTransform * Math::Vec<4>(source, 1.0);
+	Math::Vec<3> localDirection =
+		desc.InverseTransform * Math::Vec<4>(direction, 0.0);
+	Math::Vec<3> normal;
+
+	bool hit = FindMeshIntersection(
+		localSource,
+		localDirection,
+		localDirection,
+		ScaleRadius(desc.InverseTransform, radius),
+		desc.BVH,
+		desc.FaceNormals,
+		distance,
+		normal,
+		outTriangle,
+		packetIndex);
+
+	if (hit) {
+		outNormal = ToWorldNormal(desc.InverseTransform, normal);
+	}
+
+	return hit;
+}
+
+bool PhysicalEngine::FindLocalIntersection(
+	PhysicalObject* object,
+	const ObjectDescriptor& desc,
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double radius,
+	double& distance,
+	Math::Vec<3>& outNormal,
+	uint32_t& outTriangle,
+	uint32_t& packetIndex)
+{
+	const auto& params = object->PhysicalParams;
+
+	Math::Vec<3> localSource =
+		desc.InverseTransform * Math::Vec<4>(source, 1.0);
+	Math::Vec<3> localDirection =
+		desc.InverseTransform * Math::Vec<4>(direction, 0.0);
+	Math::Vec<3> normal;
+	bool hit;
+
+	outTriangle = UINT32_MAX;
+
+	switch (params.Shape) {
+	case ShapeType::Mesh:
+		hit = FindMeshIntersection(
+			localSource,
+			localDirection,
+			localDirection,
+			ScaleRadius(desc.InverseTransform, radius),
+			desc.Mesh->GetBVH(),
+			desc.Mesh->GetFaceNormals(),
+			distance,
+			normal,
+			outTriangle,
+			packetIndex);
+		break;
+	case ShapeType::Sphere:
+		hit = IntersectSphere(
+			params.Radius,
+			localSource,
+			localDirection,
+			distance,
+			normal);
+		break;
+	case ShapeType::Box:
+		hit = IntersectBox(
+			params.HalfExtents,
+			localSource,
+			localDirection,
+			distance,
+			normal);
+		break;
+	case ShapeType::Capsule:
+		hit = IntersectCapsule(
+			params.Radius,
+			params.HalfHeight,
+			localSource,
+			localDirection,
+			distance,
+			normal);
+		break;
+	case ShapeType::Plane:
+		hit = IntersectPlane(
+			localSource,
+			localDirection,
+			distance,
+			normal);
+		break;
+	default:
+		hit = desc.Field.Intersect(
+			localSource,
+			localDirection,
+			distance,
+			normal);
+		break;
+	}
+
+	if (!hit) {
+		return false;
+	}
+
+	outNormal = ToWorldNormal(desc.InverseTransform, normal);
+
+	return true;
+}
+
+void PhysicalEngine::CalculateCollision(
+	PhysicalObject* object,
+	uint32_t objectIndex,
+	const ObjectDescriptor& desc,
+	SoftObject* softObject,
+	uint32_t softObjectIndex,
+	std::vector<Contact>& contacts,
+	double timeStep)
+{
+	auto& vertices = softObject->SoftPhysicsParams.Vertices;
+	auto& positions = vertices.GetPositions();
+	auto& speeds = vertices.GetSpeeds();
+
+	std::vector<uint64_t>& cache =
+		_pairSoftDescriptors[softObjectIndex]->ContactCache;
+	double radius = GetSweepRadius(softObject);
+	size_t meshContacts = 0;
+	size_t cachedContacts = 0;
+
+	for (
+		size_t vertexIndex = 0;
+		vertexIndex < vertices.size();
+		++vertexIndex)
+	{
+		const PhysicsVec3& position = positions[vertexIndex];
+		const PhysicsVec3& speed = speeds[vertexIndex];
+
+		double distance = GetSweepDistance(speed, timeStep);
+
+		Broadphase::Box sweep;
+		sweep.Min = position - Math::Vec<3>(distance + radius);
+		sweep.Max = position + Math::Vec<3>(distance + radius);
+
+		if (!sweep.Overlaps(desc.Bounds)) {
+			continue;
+		}
+
+		uint32_t cachedPacket = UINT32_MAX;
+
+		if (!_deterministic) {
+			uint64_t entry = __atomic_load_n(
+				&cache[vertexIndex],
+				__ATOMIC_RELAXED);
+
+			if ((entry >> 32) == desc.CacheId) {
+				cachedPacket = entry;
+			}
+		}
+
+		Math::Vec<3> normal;
+		uint32_t triangle;
+		uint32_t packet = cachedPacket;
+
+		bool intersect = FindObjectIntersection(
+			object,
+			desc,
+			position,
+			speed.Normalize(),
+			radius,
+			distance,
+			normal,
+			triangle,
+			packet);
+
+		if (intersect && triangle != UINT32_MAX) {
+			++meshContacts;
+
+			if (packet == cachedPacket) {
+				++cachedContacts;
+			} else if (!_deterministic) {
+				__atomic_store_n(
+					&cache[vertexIndex],
+					(uint64_t)desc.CacheId << 32 | packet,
+					__ATOMIC_RELAXED);
+			}
+		}
+
+		if (intersect) {
+			Contact contact;
+			contact.Normal = normal;
+			contact.NormalDistance = distance *
+				fabs(normal.Dot(speed.Normalize()));
+			contact.VertexIndex = vertexIndex;
+			contact.Mu = object->PhysicalParams.Mu;
+			contact.Bounciness =
+				object->PhysicalParams.Bounciness;
+			contact.SoftObjectIndex = softObjectIndex;
+			contact.ObjectIndex = objectIndex;
+
+			contacts.push_back(contact);
+		}
+	}
+
+	_meshContacts.fetch_add(meshContacts, std::memory_order_relaxed);
+	_cachedContacts.fetch_add(cachedContacts, std::memory_order_relaxed);
+}
+
+void PhysicalEngine::ApplyCollision(
+	uint32_t softObjectIndex,
+	bool lastSubstep)
+{
+	SoftObject* object = _pairSoftObjects[softObjectIndex];
+	auto& vertices = object->SoftPhysicsParams.Vertices;
+
+	auto& positions = vertices.GetPositions();
+	auto& speeds = vertices.GetSpeeds();
+	auto& masses = vertices.GetMasses();
+	auto& inverseMasses = vertices.GetInverseMasses();
+	auto& mus = vertices.GetMus();
+	auto& bouncinesses = vertices.GetBouncinesses();
+
+	SoftObjectDescriptor& desc = *_pairSoftDescriptors[softObjectIndex];
+	auto& forces = desc.CollisionForces;
+	forces.assign(vertices.size(), PhysicsVec3(0.0));
+
+	PhysicsScalar step = desc.Step;
+	PhysicsScalar minDist = 0.005;
+
+	size_t first = _contactOffsets[softObjectIndex];
+	size_t last = _contactOffsets[softObjectIndex + 1];
+
+	// Contacts come in the order the pair tasks finished, which
+	// changes the rounding of the summed responses.
+	if (_deterministic) {
+		std::sort(
+			_contacts.begin() + first,
+			_contacts.begin() + last,
+			[](const Contact& left, const Contact& right) -> bool
+			{
+				if (left.ObjectIndex != right.ObjectIndex) {
+					return
+						left.ObjectIndex <
+						right.ObjectIndex;
+				}
+
+				return left.VertexIndex < right.VertexIndex;
+			});
+	}
+
+	for (size_t idx = first; idx < last; ++idx) {
+		const Contact& contact = _contacts[idx];
+		size_t vertexIndex = contact.VertexIndex;
+		const PhysicsVec3& speed = speeds[vertexIndex];
+		PhysicsScalar mass = masses[vertexIndex];
+
+		PhysicsVec3 normalSpeed = contact.Normal *
+			contact.Normal.Dot(speed);
+		PhysicsVec3 tangentSpeed = speed - normalSpeed;
+
+		PhysicsScalar normalSurfaceDist = contact.NormalDistance;
+
+		if (normalSurfaceDist < minDist) {
+			positions[vertexIndex] += contact.Normal *
+				(minDist - normalSurfaceDist);
+		}
+
+		PhysicsVec3 targetSpeed = contact.Normal *
+			normalSpeed.Length() *
+			(bouncinesses[vertexIndex] + contact.Bounciness) / 2.0;
+
+		PhysicsVec3 normalResponse =
+			(targetSpeed - normalSpeed) * mass / step;
+
+		PhysicsScalar mu = std::min(mus[vertexIndex], contact.Mu);
+
+		PhysicsVec3 tangentResponse(0.0);
+		PhysicsScalar frictionLimit = mu * normalResponse.Length();
+
+		if (tangentSpeed.Length() > 0.00001) {
+			PhysicsScalar maxTangentForce = tangentSpeed.Length() *
+				mass / step;
+
+			tangentResponse =
+				tangentSpeed.Normalize() * -frictionLimit;
+
+			if (tangentResponse.Length() > maxTangentForce) {
+				tangentResponse =
+					tangentResponse.Normalize() *
+					maxTangentForce;
+			}
+		}
+
+		forces[vertexIndex] += normalResponse + tangentResponse;
+	}
+
+	// Resting vertices still gain up to one tick of external
+	// acceleration before contacts cancel it, so that part of the
+	// speed does not count against sleeping.
+	auto& externalForces = vertices.GetForces();
+	PhysicsVec3 objectForce = object->SoftPhysicsParams.Force;
+	PhysicsScalar maxSpeedSq = 0;
+	PhysicsScalar maxAccelerationSq = 0;
+
+	for (size_t idx = 0; idx < vertices.size(); ++idx) {
+		speeds[idx] += forces[idx] * (inverseMasses[idx] * step);
+		positions[idx] += speeds[idx] * step;
+
+		PhysicsVec3 acceleration = externalForces[idx] + objectForce;
+		acceleration *= inverseMasses[idx];
+
+		maxSpeedSq = std::max(
+			maxSpeedSq,
+			speeds[idx].Dot(speeds[idx]));
+		maxAccelerationSq = std::max(
+			maxAccelerationSq,
+			acceleration.Dot(acceleration));
+	}
+
+	if (lastSubstep) {
+		UpdateSleepState(
+			softObjectIndex,
+			sqrt(maxSpeedSq) - sqrt(maxAccelerationSq) * step);
+	}
+}
+
+bool PhysicalEngine::IsSoftObjectAwake(
+	SoftObject* object,
+	SoftObjectDescriptor& desc)
+{
+	const Math::Vec<3>& force = object->SoftPhysicsParams.Force;
+
+	if (memcmp(force.Data, desc.LastForce.Data, sizeof(force.Data))) {
+		desc.LastForce = force;
+		desc.Sleeping = false;
+		desc.QuietTicks = 0;
+	}
+
+	if (!desc.Sleeping) {
+		return true;
+	}
+
+	for (size_t idx = 0; idx < _movedBounds.size(); ++idx) {
+		bool wake =
+			desc.Filter.Accepts(_movedFilters[idx]) &&
+			_movedBounds[idx].Overlaps(desc.SleepBounds);
+
+		if (wake) {
+			desc.Sleeping = false;
+			desc.QuietTicks = 0;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void PhysicalEngine::UpdateSleepState(
+	uint32_t softObjectIndex,
+	PhysicsScalar maxSpeed)
+{
+	SoftObjectDescriptor& desc = *_pairSoftDescriptors[softObjectIndex];
+
+	if (maxSpeed >= _sleepSpeed) {
+		desc.QuietTicks = 0;
+		return;
+	}
+
+	++desc.QuietTicks;
+
+	if (desc.QuietTicks < _sleepTicks) {
+		return;
+	}
+
+	desc.Sleeping = true;
+	desc.SleepBounds = _pairSoftBounds[softObjectIndex];
+
+	auto& speeds = _pairSoftObjects[softObjectIndex]->
+		SoftPhysicsParams.Vertices.GetSpeeds();
+	std::fill(speeds.begin(), speeds.end(), PhysicsVec3(0.0));
+}
+
+void PhysicalEngine::TraceRay(
+	const Ray& ray,
+	RayFilter filter,
+	void* filterPointer,
+	uint32_t mask,
+	RayHit& hit)
+{
+	hit.Object = nullptr;
+	hit.Distance = ray.Distance;
+
+	for (const ObjectDescriptor& desc : _objectDescriptors.GetValues()) {
+		PhysicalObject* object = desc.Object;
+
+		if (!(desc.Filter.Category & mask)) {
+			continue;
+		}
+
+		if (filter && !filter(object, filterPointer)) {
+			continue;
+		}
+
+		bool possibleCollision =
+			(ray.Source - desc.Center).Length() <=
+			desc.Radius + ray.Direction.Length() * hit.Distance;
+
+		if (!possibleCollision) {
+			continue;
+		}
+
+		Math::Vec<3> normal;
+		uint32_t triangle;
+		uint32_t packet = UINT32_MAX;
+		double dist = hit.Distance;
+
+		bool intersect = FindObjectIntersection(
+			object,
+			desc,
+			ray.Source,
+			ray.Direction,
+			0,
+			dist,
+			normal,
+			triangle,
+			packet);
+
+		if (intersect && dist < hit.Distance) {
+			hit.Object = object;
+			hit.Distance = dist;
+			hit.Normal = normal;
+			hit.Triangle = triangle;
+		}
+	}
+
+	if (hit.Object) {
+		hit.Point = ray.Source + ray.Direction * hit.Distance;
+	}
+}
+
+static bool IgnoreSetFilter(PhysicalObject* object, void* ignore)
+{
+	auto ignoreSet = static_cast<const std::set<PhysicalObject*>*>(ignore);
+	return ignoreSet->find(object) == ignoreSet->end();
+}
+
+PhysicalEngine::RayCastResult PhysicalEngine::RayCast(
+	const Math::Vec<3>& point,
+	const Math::Vec<3>& direction,
+	double distance,
+	void* userPointer,
+	const std::set<PhysicalObject*>& ignore,
+	uint32_t mask)
+{
+	Ray ray;
+	ray.Source = point;
+	ray.Direction = direction;
+	ray.Distance = distance;
+
+	RayHit hit;
+
+	_lock.LockShared();
+
+	if (ignore.empty()) {
+		TraceRay(ray, nullptr, nullptr, mask, hit);
+	} else {
+		TraceRay(
+			ray,
+			IgnoreSetFilter,
+			const_cast<std::set<PhysicalObject*>*>(&ignore),
+			mask,
+			hit);
+	}
+
+	_lock.UnlockShared();
+
+	RayCastResult res;
+	res.object = hit.Object;
+
+	if (hit.Object) {
+		res.Code = hit.Object->RayCastCallback(userPointer);
+	} else {
+		res.Code = 0;
 	}
 
 	return res;
 }
+
+void PhysicalEngine::RayCastBatch(
+	ThreadPool* threadPool,
+	const Ray* rays,
+	RayHit* results,
+	size_t count,
+	RayFilter filter,
+	void* filterPointer,
+	uint32_t mask)
+{
+	const size_t chunkSize = 64;
+
+	_lock.LockShared();
+
+	threadPool->ParallelFor(
+		count,
+		chunkSize,
+		[this, rays, results, filter, filterPointer, mask](
+			size_t begin,
+			size_t end) -> void
+		{
+			for (size_t idx = begin; idx < end; ++idx) {
+				TraceRay(
+					rays[idx],
+					filter,
+					filterPointer,
+					mask,
+					results[idx]);
+			}
+		});
+
+	_lock.UnlockShared();
+}
+
+// Corners of a packet lane in world space, transform takes them there
+// unless they already are.
+static void GetWorldTriangle(
+	const TrianglePacket& packet,
+	int lane,
+	const Math::Mat<4>* transform,
+	Math::Vec<3> corners[3])
+{
+	PhysicsVec3 packetCorners[3];
+	packet.GetCorners(lane, packetCorners);
+
+	for (int i = 0; i < 3; ++i) {
+		corners[i] = packetCorners[i];
+
+		if (transform) {
+			corners[i] = *transform * Math::Vec<4>(corners[i], 1.0);
+		}
+	}
+}
+
+// Axis aligned box in object space around the world space box.
+static Broadphase::Box ToLocalBox(
+	const Math::Mat<4>& inverseTransform,
+	const Broadphase::Box& box)
+{
+	Broadphase::Box localBox;
+	localBox.Min = Math::Vec<3>(INFINITY);
+	localBox.Max = Math::Vec<3>(-INFINITY);
+
+	for (int corner = 0; corner < 8; ++corner) {
+		Math::Vec<4> point;
+
+		for (int i = 0; i < 3; ++i) {
+			point[i] = corner & (1 << i) ? box.Max[i] : box.Min[i];
+		}
+
+		point[3] = 1;
+
+		Math::Vec<3> localPoint = inverseTransform * point;
+
+		for (int i = 0; i < 3; ++i) {
+			localBox.Min[i] =
+				std::min(localBox.Min[i], localPoint[i]);
+			localBox.Max[i] =
+				std::max(localBox.Max[i], localPoint[i]);
+		}
+	}
+
+	return localBox;
+}
+
+// Triangles are measured in world space, as offsets from point that
+// the linear part of transform takes there from object space. So only
+// the point is transformed to object space, and the result is exact
+// for any transform. Nodes are culled by the larger of two lower
+// bounds: the distance to the world box around their transformed box,
+// and their object space distance times the least stretch of the
+// transform. transform is nullptr for meshes in world space.
+static bool FindMeshClosestPoint(
+	const MeshBVH& bvh,
+	const Math::Mat<4>* transform,
+	const Math::Mat<4>& inverseTransform,
+	const Math::Vec<3>& point,
+	double& distance,
+	Math::Vec<3>& outPoint,
+	uint32_t& outTriangle)
+{
+	Math::Vec<3> localPoint = point;
+	double linear[3][3];
+
+	double stretch = 1;
+
+	if (transform) {
+		localPoint = inverseTransform * Math::Vec<4>(point, 1.0);
+		stretch = 1 / ScaleRadius(inverseTransform, 1);
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			linear[i][j] = transform ? (*transform)[i][j] : i == j;
+		}
+	}
+
+	PhysicsScalar packetDistance = distance;
+	bool hit = false;
+
+	auto toWorld = [&linear](const Math::Vec<3>& local) -> Math::Vec<3>
+	{
+		Math::Vec<3> world;
+
+		for (int i = 0; i < 3; ++i) {
+			world[i] =
+				linear[i][0] * local[0] +
+				linear[i][1] * local[1] +
+				linear[i][2] * local[2];
+		}
+
+		return world;
+	};
+
+	auto test = [&](
+		const TrianglePacket& packet,
+		PhysicsScalar& bound) -> void
+	{
+		for (int lane = 0; lane < TrianglePacket::Width; ++lane) {
+			uint32_t triangle = packet.Triangles[lane];
+
+			if (triangle == TrianglePacket::EmptyLane) {
+				continue;
+			}
+
+			Math::Vec<3> v0;
+			Math::Vec<3> edge1;
+			Math::Vec<3> edge2;
+
+			for (int i = 0; i < 3; ++i) {
+				v0[i] = packet.V0[i][lane] - localPoint[i];
+				edge1[i] = packet.Edge1[i][lane];
+				edge2[i] = packet.Edge2[i][lane];
+			}
+
+			Math::Vec<3> corner = toWorld(v0);
+			Math::Vec<3> offset = ClosestPointTriangle(
+				corner,
+				corner + toWorld(edge1),
+				corner + toWorld(edge2),
+				Math::Vec<3>(0.0));
+			double dist = offset.Length();
+
+			if (dist < distance) {
+				distance = dist;
+				outPoint = point + offset;
+				outTriangle = triangle;
+				bound = dist;
+				hit = true;
+			}
+		}
+	};
+
+	if (!transform) {
+		bvh.TraverseNearest(localPoint, packetDistance, test);
+		return hit;
+	}
+
+	auto nodeDistance = [&](
+		const PhysicsVec3& min,
+		const PhysicsVec3& max) -> PhysicsScalar
+	{
+		Math::Vec<3> center = (Math::Vec<3>(min) + max) * 0.5;
+		Math::Vec<3> extent = (Math::Vec<3>(max) - min) * 0.5;
+		Math::Vec<3> worldCenter = toWorld(center - localPoint);
+		double distanceSq = 0;
+
+		for (int i = 0; i < 3; ++i) {
+			double radius =
+				fabs(linear[i][0]) * extent[0] +
+				fabs(linear[i][1]) * extent[1] +
+				fabs(linear[i][2]) * extent[2];
+			double outside = std::max(
+				fabs(worldCenter[i]) - radius,
+				0.0);
+
+			distanceSq += outside * outside;
+		}
+
+		Math::Vec<3> nearest = localPoint;
+
+		for (int i = 0; i < 3; ++i) {
+			nearest[i] = std::min<double>(
+				std::max<double>(nearest[i], min[i]),
+				max[i]);
+		}
+
+		return std::max(
+			sqrt(distanceSq),
+			(nearest - localPoint).Length() * stretch);
+	};
+
+	bvh.TraverseNearest(packetDistance, nodeDistance, test);
+
+	return hit;
+}
+
+bool PhysicalEngine::FindClosestPoint(
+	const ObjectDescriptor& desc,
+	const Math::Vec<3>& point,
+	double& distance,
+	PointHit& hit,
+	bool& inside)
+{
+	const auto& params = desc.Object->PhysicalParams;
+
+	Math::Vec<3> localPoint =
+		desc.InverseTransform * Math::Vec<4>(point, 1.0);
+	Math::Vec<3> closest;
+	Math::Vec<3> normal;
+	uint32_t triangle = UINT32_MAX;
+	bool found = false;
+
+	inside = false;
+
+	switch (params.Shape) {
+	case ShapeType::Mesh: {
+		// Own static meshes are kept in world space.
+		bool local = desc.Mesh || params.Dynamic;
+		const MeshBVH& bvh = desc.Mesh ? desc.Mesh->GetBVH() : desc.BVH;
+
+		found = FindMeshClosestPoint(
+			bvh,
+			local ? &desc.Transform : nullptr,
+			desc.InverseTransform,
+			point,
+			distance,
+			closest,
+			triangle);
+
+		if (!found) {
+			return false;
+		}
+
+		const std::vector<PhysicsVec3>& faceNormals = desc.Mesh ?
+			desc.Mesh->GetFaceNormals() :
+			desc.FaceNormals;
+		normal = faceNormals[triangle];
+
+		if (local) {
+			normal = ToWorldNormal(desc.InverseTransform, normal);
+		}
+
+		break;
+	}
+	case ShapeType::Heightfield: {
+		double height;
+		bool onGrid = desc.Field.GetHeight(
+			localPoint[0],
+			localPoint[1],
+			height);
+		inside = onGrid && localPoint[2] < height;
+
+		Math::Vec<3> extent(
+			distance * ScaleRadius(desc.InverseTransform, 1));
+
+		desc.Field.ForEachTriangle(
+			localPoint - extent,
+			localPoint + extent,
+			[&](
+				const Math::Vec<3>& v0,
+				const Math::Vec<3>& v1,
+				const Math::Vec<3>& v2) -> bool
+			{
+				Math::Vec<3> w0 =
+					desc.Transform * Math::Vec<4>(v0, 1.0);
+				Math::Vec<3> w1 =
+					desc.Transform * Math::Vec<4>(v1, 1.0);
+				Math::Vec<3> w2 =
+					desc.Transform * Math::Vec<4>(v2, 1.0);
+
+				Math::Vec<3> candidate =
+					ClosestPointTriangle(w0, w1, w2, point);
+				double dist = (candidate - point).Length();
+
+				if (dist < distance) {
+					distance = dist;
+					closest = candidate;
+					normal = (w1 - w0).Cross(w2 - w0);
+					normal = normal.Normalize();
+					found = true;
+				}
+
+				return false;
+			});
+
+		if (!found) {
+			return false;
+		}
+
+		break;
+	}
+	default: {
+		Math::Vec<3> localClosest;
+
+		switch (params.Shape) {
+		case ShapeType::Sphere:
+			inside = ClosestPointSphere(
+				params.Radius,
+				localPoint,
+				localClosest,
+				normal);
+			break;
+		case ShapeType::Box:
+			inside = ClosestPointBox(
+				params.HalfExtents,
+				localPoint,
+				localClosest,
+				normal);
+			break;
+		case ShapeType::Capsule:
+			inside = ClosestPointCapsule(
+				params.Radius,
+				params.HalfHeight,
+				localPoint,
+				localClosest,
+				normal);
+			break;
+		default:
+			inside = ClosestPointPlane(
+				localPoint,
+				localClosest,
+				normal);
+			break;
+		}
+
+		closest = desc.Transform * Math::Vec<4>(localClosest, 1.0);
+		normal = ToWorldNormal(desc.InverseTransform, normal);
+
+		double dist = (closest - point).Length();
+
+		if (!(dist < distance)) {
+			return false;
+		}
+
+		distance = dist;
+		break;
+	}
+	}
+
+	hit.Object = desc.Object;
+	hit.Distance = distance;
+	hit.Point = closest;
+	hit.Normal = normal;
+	hit.Inside = inside;
+	hit.Triangle = triangle;
+
+	return true;
+}
+
+bool PhysicalEngine::OverlapsObject(
+	const ObjectDescriptor& desc,
+	const Broadphase::Box& box)
+{
+	const auto& params = desc.Object->PhysicalParams;
+	const Math::Mat<4>& transform = desc.Transform;
+
+	Math::Vec<3> origin = transform * Math::Vec<4>({0.0, 0.0, 0.0, 1.0});
+
+	switch (params.Shape) {
+	case ShapeType::Mesh: {
+		bool local = desc.Mesh || params.Dynamic;
+		const MeshBVH& bvh = desc.Mesh ? desc.Mesh->GetBVH() : desc.BVH;
+		Broadphase::Box query = box;
+
+		if (local) {
+			query = ToLocalBox(desc.InverseTransform, box);
+		}
+
+		bool overlaps = false;
+
+		bvh.Query(
+			query.Min,
+			query.Max,
+			[&](const TrianglePacket& packet) -> bool
+			{
+				const int width = TrianglePacket::Width;
+
+				for (int lane = 0; lane < width; ++lane) {
+					if (packet.Triangles[lane] ==
+						TrianglePacket::EmptyLane)
+					{
+						continue;
+					}
+
+					Math::Vec<3> corners[3];
+					GetWorldTriangle(
+						packet,
+						lane,
+						local ? &transform : nullptr,
+						corners);
+
+					overlaps = OverlapTriangleBox(
+						corners[0],
+						corners[1],
+						corners[2],
+						box.Min,
+						box.Max);
+
+					if (overlaps) {
+						return true;
+					}
+				}
+
+				return false;
+			});
+
+		return overlaps;
+	}
+	case ShapeType::Sphere:
+		return OverlapCapsuleBox(
+			origin,
+			origin,
+			ScaleRadius(transform, params.Radius),
+			box.Min,
+			box.Max);
+	case ShapeType::Box: {
+		Math::Vec<3> axes[3];
+
+		for (int i = 0; i < 3; ++i) {
+			Math::Vec<4> axis(0.0);
+			axis[i] = params.HalfExtents[i];
+			axes[i] = transform * axis;
+		}
+
+		return OverlapOrientedBox(origin, axes, box.Min, box.Max);
+	}
+	case ShapeType::Capsule: {
+		double halfHeight = params.HalfHeight;
+
+		return OverlapCapsuleBox(
+			transform * Math::Vec<4>({0.0, 0.0, -halfHeight, 1.0}),
+			transform * Math::Vec<4>({0.0, 0.0, halfHeight, 1.0}),
+			ScaleRadius(transform, params.Radius),
+			box.Min,
+			box.Max);
+	}
+	case ShapeType::Plane:
+		return OverlapPlaneBox(
+			origin,
+			ToWorldNormal(
+				desc.InverseTransform,
+				Math::Vec<3>({0.0, 0.0, 1.0})),
+			box.Min,
+			box.Max);
+	default: {
+		Broadphase::Box query = ToLocalBox(desc.InverseTransform, box);
+		bool overlaps = false;
+
+		desc.Field.ForEachTriangle(
+			query.Min,
+			query.Max,
+			[&](
+				const Math::Vec<3>& v0,
+				const Math::Vec<3>& v1,
+				const Math::Vec<3>& v2) -> bool
+			{
+				overlaps = OverlapTriangleBox(
+					transform * Math::Vec<4>(v0, 1.0),
+					transform * Math::Vec<4>(v1, 1.0),
+					transform * Math::Vec<4>(v2, 1.0),
+					box.Min,
+					box.Max);
+
+				return overlaps;
+			});
+
+		if (overlaps) {
+			return true;
+		}
+
+		// Without a crossing triangle the box is wholly above or
+		// below the surface.
+		Math::Vec<3> center = (box.Min + box.Max) * 0.5;
+		Math::Vec<3> localCenter =
+			desc.InverseTransform * Math::Vec<4>(center, 1.0);
+		double height;
+		bool onGrid = desc.Field.GetHeight(
+			localCenter[0],
+			localCenter[1],
+			height);
+
+		return onGrid && localCenter[2] < height;
+	}
+	}
+}
+
+// Queries skip disabled objects like the step does, also those
+// disabled since.
+bool PhysicalEngine::IsQueried(const ObjectDescriptor& desc, uint32_t mask)
+{
+	return
+		desc.Object->PhysicalParams.Enabled &&
+		(desc.Filter.Category & mask);
+}
+
+size_t PhysicalEngine::OverlapSphere(
+	const Math::Vec<3>& center,
+	double radius,
+	PhysicalObject** objects,
+	size_t capacity,
+	uint32_t mask)
+{
+	Broadphase::Box bounds;
+	bounds.Min = center - Math::Vec<3>(radius);
+	bounds.Max = center + Math::Vec<3>(radius);
+
+	size_t count = 0;
+
+	_lock.LockShared();
+
+	_queryBroadphase.Query(
+		bounds,
+		[&](uint32_t index) -> void
+		{
+			const ObjectDescriptor& desc =
+				*_pairObjectDescriptors[index];
+
+			if (!IsQueried(desc, mask)) {
+				return;
+			}
+
+			PointHit hit;
+			double distance = radius;
+			bool inside;
+
+			bool near = FindClosestPoint(
+				desc,
+				center,
+				distance,
+				hit,
+				inside);
+
+			if (!near && !inside) {
+				return;
+			}
+
+			if (count < capacity) {
+				objects[count] = desc.Object;
+			}
+
+			++count;
+		});
+
+	_lock.UnlockShared();
+
+	return count;
+}
+
+size_t PhysicalEngine::OverlapAABB(
+	const Math::Vec<3>& min,
+	const Math::Vec<3>& max,
+	PhysicalObject** objects,
+	size_t capacity,
+	uint32_t mask)
+{
+	Broadphase::Box box;
+	box.Min = min;
+	box.Max = max;
+
+	size_t count = 0;
+
+	_lock.LockShared();
+
+	_queryBroadphase.Query(
+		box,
+		[&](uint32_t index) -> void
+		{
+			const ObjectDescriptor& desc =
+				*_pairObjectDescriptors[index];
+
+			bool overlaps =
+				IsQueried(desc, mask) &&
+				OverlapsObject(desc, box);
+
+			if (!overlaps) {
+				return;
+			}
+
+			if (count < capacity) {
+				objects[count] = desc.Object;
+			}
+
+			++count;
+		});
+
+	_lock.UnlockShared();
+
+	return count;
+}
+
+void PhysicalEngine::ClosestPoint(
+	const Math::Vec<3>& point,
+	double maxDistance,
+	PointHit& hit,
+	uint32_t mask)
+{
+	hit.Object = nullptr;
+	hit.Distance = maxDistance;
+
+	double distance = maxDistance;
+
+	Broadphase::Box query;
+	query.Min = point - Math::Vec<3>(distance);
+	query.Max = point + Math::Vec<3>(distance);
+
+	_lock.LockShared();
+
+	_queryBroadphase.Query(
+		query,
+		[&](uint32_t index) -> void
+		{
+			const ObjectDescriptor& desc =
+				*_pairObjectDescriptors[index];
+
+			if (!IsQueried(desc, mask)) {
+				return;
+			}
+
+			// Bounds farther than the nearest point so far are
+			// skipped.
+			Broadphase::Box bounds;
+			bounds.Min = point - Math::Vec<3>(distance);
+			bounds.Max = point + Math::Vec<3>(distance);
+
+			if (!desc.Bounds.Overlaps(bounds)) {
+				return;
+			}
+
+			bool inside;
+			FindClosestPoint(desc, point, distance, hit, inside);
+		});
+
+	_lock.UnlockShared();
+}
@@ -2,12 +2,23 @@
 #define _PHYSICAL_ENGINE_H
 
 #include <set>
-#include <map>
+#include <atomic>
 
 #include "PhysicalEngineBase.h"
 #include "PhysicalObject.h"
 #include "SoftObject.h"
+#include "PhysicsScalar.h"
+#include "MeshBVH.h"
+#include "Heightfield.h"
+#include "CollisionMesh.h"
+#include "Broadphase.h"
+#include "LinkSolver.h"
+#include "SpatialHash.h"
 #include "../Utils/ThreadPool.h"
+#include "../Utils/SlotMap.h"
+#include "../Utils/MPSCQueue.h"
+#include "../Sync/rwlock.h"
+#include "../Sync/mutex.h"
 
 class PhysicalEngine : public PhysicalEngineBase
 {
@@ -18,63 +29,451 @@ public:
 		uint32_t Code;
 	};
 
+	struct Ray
+	{
+		Math::Vec<3> Source;
+		Math::Vec<3> Direction;
+		double Distance;
+	};
+
+	struct RayHit
+	{
+		// nullptr if nothing was hit.
+		PhysicalObject* Object;
+
+		// Measured in direction lengths.
+		double Distance;
+		Math::Vec<3> Point;
+		Math::Vec<3> Normal;
+
+		// UINT32_MAX for shapes other than meshes.
+		uint32_t Triangle;
+	};
+
+	struct PointHit
+	{
+		// nullptr if no surface is within the distance.
+		PhysicalObject* Object;
+
+		// Nearest surface point, its distance and the outward normal
+		// there. Inside is true for points inside solid shapes,
+		// those other than meshes.
+		double Distance;
+		Math::Vec<3> Point;
+		Math::Vec<3> Normal;
+		bool Inside;
+
+		// UINT32_MAX for shapes other than meshes.
+		uint32_t Triangle;
+	};
+
+	// Identify registered objects. Calls taking the handle of a
+	// removed object ignore it.
+	struct ObjectHandle
+	{
+		uint32_t Index;
+		uint32_t Generation;
+	};
+
+	struct SoftObjectHandle
+	{
+		uint32_t Index;
+		uint32_t Generation;
+	};
+
+	struct Statistics
+	{
+		size_t AwakeSoftObjects;
+		size_t SleepingSoftObjects;
+
+		// Broadphase pairs skipped by collision filters, see
+		// Broadphase::FindPairs, and pairs passed on to collision,
+		// summed over substeps.
+		size_t FilteredPairs;
+		size_t CollisionPairs;
+
+		// Soft vertex contacts with meshes, and those of them found
+		// in the triangle packet the vertex hit last time.
+		size_t MeshContacts;
+		size_t CachedContacts;
+	};
+
+	// Returns false for objects the ray must pass through.
+	typedef bool (*RayFilter)(PhysicalObject* object, void* userPointer);
+
 	PhysicalEngine();
 	~PhysicalEngine();
 
 	void Run(ThreadPool* threadPool, double timeStep) override;
 
-	void RegisterObject(PhysicalObject* object);
-	void RemoveObject(PhysicalObject* object);
-	void RegisterObject(SoftObject* object);
-	void RemoveObject(SoftObject* object);
+	// Registration, removal and WakeUp are queued without waiting
+	// for a running step and applied at the start of the next Run.
+	// Returned handles can be used right away; objects take part in
+	// steps and ray casts once the queue has been applied.
+	ObjectHandle RegisterObject(PhysicalObject* object);
+	void RemoveObject(ObjectHandle handle);
+	SoftObjectHandle RegisterObject(SoftObject* object);
+	void RemoveObject(SoftObjectHandle handle);
+
+	// Soft objects whose vertices all stay slower than speed, not
+	// counting one tick of external acceleration, for ticks
+	// consecutive ticks are put to sleep and skipped by Run.
+	// They wake up on WakeUp, when their Force changes or when a
+	// moving dynamic object gets close to them.
+	void SetSleepParameters(double speed, uint32_t ticks);
+	void WakeUp(SoftObjectHandle handle);
+
+	// In deterministic mode results are bit identical for any thread
+	// count, as long as objects are registered in the same order.
+	// Contacts are applied sorted by object and vertex, and the
+	// per-vertex triangle packet cache is not used, since a cached
+	// packet can break ties between equally near triangles.
+	void SetDeterministic(bool deterministic);
+
+	// Snapshots for rollback hold the vertex positions, speeds and
+	// forces, Force and sleep state of the soft objects and the
+	// Matrix of the dynamic objects, each vertex array copied whole.
+	// Objects are recorded by handle, a snapshot can be restored
+	// while the same objects are registered, with the same vertex
+	// counts; registrations still queued are not part of it. The
+	// per-vertex triangle packet cache is dropped on restore, so a
+	// resimulation repeats the original steps exactly only in
+	// deterministic mode. snapshot keeps its capacity, repeated
+	// saves do not allocate.
+	void SaveSnapshot(std::vector<uint8_t>& snapshot);
+	bool RestoreSnapshot(const std::vector<uint8_t>& snapshot);
+
+	// Counters of the last Run.
+	Statistics GetStatistics();
 
 	RayCastResult RayCast(
 		const Math::Vec<3>& point,
 		const Math::Vec<3>& direction,
 		double distance,
 		void* userPointer,
-		std::set<PhysicalObject*> ignore = {});
+		const std::set<PhysicalObject*>& ignore = {},
+		uint32_t mask = UINT32_MAX);
+
+	// Traces count rays into results in parallel. RayCastCallback
+	// is not called for batched rays.
+	void RayCastBatch(
+		ThreadPool* threadPool,
+		const Ray* rays,
+		RayHit* results,
+		size_t count,
+		RayFilter filter = nullptr,
+		void* filterPointer = nullptr,
+		uint32_t mask = UINT32_MAX);
+
+	// Spatial queries against enabled objects whose Category shares
+	// a bit with mask, found through an index of their bounds as of
+	// the last Run. Like ray casts they can run concurrently with
+	// each other. The overlap queries write up to capacity overlapping
+	// objects and return how many there are in total. Shapes other
+	// than meshes are solid, heightfields down to their lowest
+	// sample. Results are exact for rotations and uniform scales,
+	// for other transforms only on meshes and heightfields.
+	size_t OverlapSphere(
+		const Math::Vec<3>& center,
+		double radius,
+		PhysicalObject** objects,
+		size_t capacity,
+		uint32_t mask = UINT32_MAX);
+	size_t OverlapAABB(
+		const Math::Vec<3>& min,
+		const Math::Vec<3>& max,
+		PhysicalObject** objects,
+		size_t capacity,
+		uint32_t mask = UINT32_MAX);
+
+	// Nearest surface point of all objects within maxDistance of
+	// point. Tight distances skip more of the objects and triangles.
+	void ClosestPoint(
+		const Math::Vec<3>& point,
+		double maxDistance,
+		PointHit& hit,
+		uint32_t mask = UINT32_MAX);
 
 private:
 	struct ObjectDescriptor
 	{
-		std::vector<Math::Vec<3>> Vertices;
-		std::vector<Math::Vec<3>> Normals;
+		PhysicalObject* Object;
+
+		// Object space bounds of an own mesh, world bounds of a
+		// moved dynamic one are those of this box transformed.
+		Broadphase::Box LocalBounds;
+
+		// Normalized sum of vertex normals per triangle of an own
+		// mesh in index order, in the space of its BVH: world space
+		// for static objects and object space for dynamic ones.
+		std::vector<PhysicsVec3> FaceNormals;
+
 		Math::Vec<3> Center;
 		double Radius;
+		Broadphase::Box Bounds;
+		Broadphase::Filter Filter;
+
+		// Changes with every transform update, so that cached
+		// packet indices of soft vertices can be recognized as
+		// stale.
+		uint32_t CacheId;
+
+		// Built in world space for static objects and in object
+		// space for dynamic ones.
+		MeshBVH BVH;
+		Math::Mat<4> Transform;
+		Math::Mat<4> InverseTransform;
+
+		// Objects with a shared mesh or another shape than an own
+		// mesh are queried in object space and keep no world space
+		// geometry.
+		CollisionMesh* Mesh;
+		Heightfield Field;
+	};
+
+	struct SoftObjectDescriptor
+	{
+		SoftObject* Object;
+
+		LinkSolver Links;
+		std::vector<PhysicsVec3> CollisionForces;
+
+		// Substep count and length of the current tick.
+		uint32_t Substeps;
+		double Step;
+		bool InPass;
+
+		bool Sleeping;
+		uint32_t QuietTicks;
+		Math::Vec<3> LastForce;
+
+		// Bounds at the moment the object fell asleep.
+		Broadphase::Box SleepBounds;
+
+		Broadphase::Filter Filter;
+
+		// Per vertex CacheId of the object last hit in the upper and
+		// its packet index in the lower half. Accessed atomically as
+		// several objects are collided with in parallel.
+		std::vector<uint64_t> ContactCache;
+	};
+
+	// Soft objects with fewer links are solved whole as one task,
+	// larger ones are split across the pool by link color.
+	static const size_t ParallelLinkThreshold = 4096;
+
+	// Vertex of a soft object taking part in soft collisions.
+	struct SoftPoint
+	{
+		uint32_t Collider;
+		uint32_t Vertex;
+		PhysicsScalar InverseMass;
+		PhysicsScalar Radius;
 	};
 
 	struct Contact
 	{
-		Math::Vec<3> Normal;
-		double NormalDistance;
-		double Mu;
-		double Bounciness;
+		PhysicsVec3 Normal;
+		PhysicsScalar NormalDistance;
+		PhysicsScalar Mu;
+		PhysicsScalar Bounciness;
 
 		size_t VertexIndex;
+		uint32_t SoftObjectIndex;
+
+		// Index of the physical object in _pairObjects.
+		uint32_t ObjectIndex;
+	};
+
+	// Fixed size part of a soft object in a snapshot, followed by its
+	// position, speed and force arrays. Zeroed before it is filled,
+	// so its padding does not carry stale bytes into the snapshot.
+	struct SoftObjectState
+	{
+		Math::Vec<3> Force;
+		Math::Vec<3> LastForce;
+		Broadphase::Box SleepBounds;
+		SoftObjectHandle Handle;
+		uint32_t VertexCount;
+		uint32_t QuietTicks;
+		bool Sleeping;
 	};
 
-	std::set<PhysicalObject*> _objects;
-	std::map<PhysicalObject*, ObjectDescriptor*> _objectDescriptors;
-	std::set<SoftObject*> _softObjects;
+	struct Command
+	{
+		enum class CommandType
+		{
+			Register = 0,
+			Remove = 1,
+			RegisterSoft = 2,
+			RemoveSoft = 3,
+			WakeUp = 4
+		};
+
+		CommandType Type;
+		ObjectHandle Object;
+		SoftObjectHandle SoftObject;
+
+		// New descriptors of register commands.
+		ObjectDescriptor* Descriptor;
+		SoftObjectDescriptor* SoftDescriptor;
+	};
+
+	// Descriptors are stored densely and may move on removal, so
+	// pointers to them are only kept within one Run.
+	SlotMap<ObjectDescriptor, ObjectHandle> _objectDescriptors;
+	SlotMap<SoftObjectDescriptor, SoftObjectHandle> _softObjectDescriptors;
+
+	// Guards the handle slots of both maps, which registration
+	// reserves while a step may be running. Held for slot
+	// bookkeeping and by snapshots, which look up descriptors by
+	// handle. Taken after _lock.
+	Sync::Mutex _handleMutex;
+	MPSCQueue<Command> _commands;
+
+	// Exclusive for the physics step and object registration,
+	// shared for queries.
+	Sync::RWLock _lock;
 
-	Sync::Mutex _mutex;
+	double _sleepSpeed;
+	uint32_t _sleepTicks;
+	bool _deterministic;
+	Statistics _statistics;
+	std::atomic<size_t> _meshContacts;
+	std::atomic<size_t> _cachedContacts;
+	std::atomic<uint32_t> _nextCacheId;
 
-	std::map<SoftObject*, std::vector<Contact>> _contacts;
-	Sync::Mutex _effectMutex;
+	std::vector<SoftObject*> _awakeSoftObjects;
+	std::vector<SoftObjectDescriptor*> _awakeSoftDescriptors;
+
+	// Old and new bounds of dynamic objects moved this tick.
+	std::vector<ObjectDescriptor*> _movedDescriptors;
+	std::vector<Broadphase::Box> _movedBounds;
+	std::vector<Broadphase::Filter> _movedFilters;
+
+	Broadphase _broadphase;
+	std::vector<PhysicalObject*> _pairObjects;
+	std::vector<ObjectDescriptor*> _pairObjectDescriptors;
+	std::vector<Broadphase::Box> _pairObjectBounds;
+	std::vector<Broadphase::Filter> _pairObjectFilters;
+
+	// Index of _pairObjectBounds for the spatial queries, which run
+	// between steps.
+	Broadphase _queryBroadphase;
+
+	// Soft objects taking part in the current substep.
+	std::vector<SoftObject*> _pairSoftObjects;
+	std::vector<SoftObjectDescriptor*> _pairSoftDescriptors;
+	std::vector<Broadphase::Box> _pairSoftBounds;
+	std::vector<Broadphase::Filter> _pairSoftFilters;
+	std::vector<Broadphase::Pair> _pairs;
+
+	// Soft objects with SoftCollision, those of the current pass
+	// first. Their vertices are copied into the _softPoint arrays in
+	// the same order, the first _movingSoftPoints of them are moved
+	// by collisions while the rest are fixed obstacles.
+	std::vector<SoftObject*> _softColliders;
+	std::vector<SoftObjectDescriptor*> _softColliderDescriptors;
+	std::vector<SoftPoint> _softPoints;
+	std::vector<PhysicsVec3> _softPointPositions;
+	std::vector<PhysicsVec3> _softPointSpeeds;
+	std::vector<PhysicsVec3> _softPointPositionDeltas;
+	std::vector<PhysicsVec3> _softPointSpeedDeltas;
+	size_t _movingSoftPoints;
+	SpatialHash _softHash;
+
+	// Contacts are collected into one arena per pool thread, then
+	// grouped by soft object index into _contacts, soft object i
+	// owning [_contactOffsets[i], _contactOffsets[i + 1]).
+	// All buffers keep their capacity between ticks.
+	std::vector<std::vector<Contact>> _contactArenas;
+	std::vector<Contact> _contacts;
+	std::vector<size_t> _contactOffsets;
+	std::vector<size_t> _contactCursors;
+
+	void InitializeObject(
+		PhysicalObject* object,
+		ObjectDescriptor& desc);
+	void DeinitializeObject(ObjectDescriptor& desc);
+	void ProcessCommands();
+	void ApplyCommand(Command& command);
 
-	void InitializeObject(PhysicalObject* object);
-	void DeinitializeObject(PhysicalObject* object);
 	void UpdateObjectDescriptor(
 		PhysicalObject* object,
 		ObjectDescriptor& desc);
+	void UpdateLocalDescriptor(
+		PhysicalObject* object,
+		ObjectDescriptor& desc);
+	bool IsTransformChanged(
+		PhysicalObject* object,
+		const ObjectDescriptor& desc);
+
+	bool FindObjectIntersection(
+		PhysicalObject* object,
+		const ObjectDescriptor& desc,
+		const Math::Vec<3>& source,
+		const Math::Vec<3>& direction,
+		double radius,
+		double& distance,
+		Math::Vec<3>& outNormal,
+		uint32_t& outTriangle,
+		uint32_t& packetIndex);
+	bool FindLocalIntersection(
+		PhysicalObject* object,
+		const ObjectDescriptor& desc,
+		const Math::Vec<3>& source,
+		const Math::Vec<3>& direction,
+		double radius,
+		double& distance,
+		Math::Vec<3>& outNormal,
+		uint32_t& outTriangle,
+		uint32_t& packetIndex);
+
+	// Updates hit with the nearest surface point of the object if it
+	// is nearer than distance, shortening distance. inside is set for
+	// points inside the object.
+	bool FindClosestPoint(
+		const ObjectDescriptor& desc,
+		const Math::Vec<3>& point,
+		double& distance,
+		PointHit& hit,
+		bool& inside);
+	bool OverlapsObject(
+		const ObjectDescriptor& desc,
+		const Broadphase::Box& box);
+	static bool IsQueried(const ObjectDescriptor& desc, uint32_t mask);
+
+	void TraceRay(
+		const Ray& ray,
+		RayFilter filter,
+		void* filterPointer,
+		uint32_t mask,
+		RayHit& hit);
 
 	void CalculateCollision(
 		PhysicalObject* object,
-		SoftObject* SoftObject,
+		uint32_t objectIndex,
+		const ObjectDescriptor& desc,
+		SoftObject* softObject,
+		uint32_t softObjectIndex,
+		std::vector<Contact>& contacts,
 		double timeStep);
-	void ApplyForces(SoftObject* object, double timeStep);
-	void ApplyCollision(SoftObject* object, double timeStep);
+	void MergeContacts();
+	void CollideSoftObjects(ThreadPool* threadPool);
+	void FindSoftContacts(size_t point);
+	Broadphase::Box GetSoftObjectBounds(
+		SoftObject* object,
+		double timeStep);
+	void ApplyCollision(uint32_t softObjectIndex, bool lastSubstep);
+	void RunSubstep(ThreadPool* threadPool, uint32_t substep);
+	bool IsSoftObjectAwake(
+		SoftObject* object,
+		SoftObjectDescriptor& desc);
+	void UpdateSleepState(
+		uint32_t softObjectIndex,
+		PhysicsScalar maxSpeed);
+
+	bool IsSnapshotValid(const std::vector<uint8_t>& snapshot);
 };
 
 #endif
@@ -2,17 +2,54 @@
 #define _PHYSICAL_OBJECT_H
 
 #include <vector>
+#include <cstdint>
 
 #include "../Math/vec.h"
 #include "../Math/mat.h"
+#include "CollisionMesh.h"
 
 class PhysicalObject
 {
 public:
 	struct PhysicalValues
 	{
+		// Mesh objects collide with their triangles, or with the
+		// shared CollisionMesh if one is set. The others collide
+		// with an analytic shape in object space, see Primitives.h
+		// and Heightfield.h.
+		enum class ShapeType
+		{
+			Mesh = 0,
+			Sphere = 1,
+			Box = 2,
+			Capsule = 3,
+			Plane = 4,
+			Heightfield = 5
+		};
+
 		bool Enabled;
 
+		ShapeType Shape;
+
+		// Sphere and capsule radius, box half extents and
+		// capsule half height along z.
+		double Radius;
+		Math::Vec<3> HalfExtents;
+		double HalfHeight;
+
+		// Heightfield samples, row by row with HeightsWidth samples
+		// along x, CellSize apart in both directions. Registering
+		// the object moves them into the engine, leaving Heights
+		// empty.
+		std::vector<float> Heights;
+		uint32_t HeightsWidth;
+		uint32_t HeightsDepth;
+		double CellSize;
+
+		// Takes precedence over Vertices, Normals and Indices.
+		// Registering the object adds a reference to it.
+		CollisionMesh* Mesh;
+
 		std::vector<Math::Vec<3>> Vertices;
 		std::vector<Math::Vec<3>> Normals;
 		std::vector<uint32_t> Indices;
@@ -21,6 +58,12 @@ public:
 
 		bool Dynamic;
 
+		// Pairs with soft objects only if each one's Category
+		// shares a bit with the other's Mask. Rays with a mask
+		// only hit objects whose Category shares a bit with it.
+		uint32_t Category;
+		uint32_t Mask;
+
 		double Mu;
 		double Bounciness;
 	};
@@ -30,7 +73,17 @@ public:
 	PhysicalObject()
 	{
 		PhysicalParams.Enabled = false;
+		PhysicalParams.Shape = PhysicalValues::ShapeType::Mesh;
+		PhysicalParams.Mesh = nullptr;
+		PhysicalParams.Radius = 0;
+		PhysicalParams.HalfExtents = Math::Vec<3>(0.0);
+		PhysicalParams.HalfHeight = 0;
+		PhysicalParams.HeightsWidth = 0;
+		PhysicalParams.HeightsDepth = 0;
+		PhysicalParams.CellSize = 1;
 		PhysicalParams.Dynamic = false;
+		PhysicalParams.Category = 1;
+		PhysicalParams.Mask = UINT32_MAX;
 		PhysicalParams.ExternalMatrix = nullptr;
 	}
 
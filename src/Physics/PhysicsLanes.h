@@ -0,0 +1,100 @@
+#ifndef _PHYSICS_LANES_H
+#define _PHYSICS_LANES_H
+
+#include <immintrin.h>
+
+#include "PhysicsScalar.h"
+
+// 256 bit lanes of PhysicsScalar for the AVX2 code paths. Functions
+// using them are compiled with the avx2 target attribute and selected
+// at run time, so the rest of the build keeps the baseline ISA.
+static const int LanesWidth = 32 / sizeof(PhysicsScalar);
+
+#ifdef PHYSICS_SINGLE_PRECISION
+typedef __m256 Lanes;
+#define LanesLoad _mm256_load_ps
+#define LanesStore _mm256_storeu_ps
+#define LanesSet _mm256_set1_ps
+#define LanesZero _mm256_setzero_ps
+#define LanesAdd _mm256_add_ps
+#define LanesSub _mm256_sub_ps
+#define LanesMul _mm256_mul_ps
+#define LanesDiv _mm256_div_ps
+#define LanesSqrt _mm256_sqrt_ps
+#define LanesAnd _mm256_and_ps
+#define LanesOr _mm256_or_ps
+#define LanesCmp _mm256_cmp_ps
+#define LanesMask _mm256_movemask_ps
+#else
+typedef __m256d Lanes;
+#define LanesLoad _mm256_load_pd
+#define LanesStore _mm256_storeu_pd
+#define LanesSet _mm256_set1_pd
+#define LanesZero _mm256_setzero_pd
+#define LanesAdd _mm256_add_pd
+#define LanesSub _mm256_sub_pd
+#define LanesMul _mm256_mul_pd
+#define LanesDiv _mm256_div_pd
+#define LanesSqrt _mm256_sqrt_pd
+#define LanesAnd _mm256_and_pd
+#define LanesOr _mm256_or_pd
+#define LanesCmp _mm256_cmp_pd
+#define LanesMask _mm256_movemask_pd
+#endif
+
+// Loads three consecutive scalars from each of LanesWidth sources, such
+// as the Vec3s of some vertices, and transposes them into one register
+// per component. Masked loads do not touch memory past the third
+// scalar.
+#ifdef PHYSICS_SINGLE_PRECISION
+__attribute__((target("avx2"), always_inline))
+static inline void LanesGather3(
+	const PhysicsScalar* const* sources,
+	Lanes* lanes)
+{
+	__m128i mask = _mm_set_epi32(0, -1, -1, -1);
+	__m256 rows[4];
+
+	for (int i = 0; i < 4; ++i) {
+		__m128 low = _mm_maskload_ps(sources[i], mask);
+		__m128 high = _mm_maskload_ps(sources[i + 4], mask);
+		rows[i] = _mm256_insertf128_ps(
+			_mm256_castps128_ps256(low),
+			high,
+			1);
+	}
+
+	__m256 low01 = _mm256_unpacklo_ps(rows[0], rows[1]);
+	__m256 high01 = _mm256_unpackhi_ps(rows[0], rows[1]);
+	__m256 low23 = _mm256_unpacklo_ps(rows[2], rows[3]);
+	__m256 high23 = _mm256_unpackhi_ps(rows[2], rows[3]);
+
+	lanes[0] = _mm256_shuffle_ps(low01, low23, 0x44);
+	lanes[1] = _mm256_shuffle_ps(low01, low23, 0xEE);
+	lanes[2] = _mm256_shuffle_ps(high01, high23, 0x44);
+}
+#else
+__attribute__((target("avx2"), always_inline))
+static inline void LanesGather3(
+	const PhysicsScalar* const* sources,
+	Lanes* lanes)
+{
+	__m256i mask = _mm256_set_epi64x(0, -1, -1, -1);
+	__m256d rows[4];
+
+	for (int i = 0; i < 4; ++i) {
+		rows[i] = _mm256_maskload_pd(sources[i], mask);
+	}
+
+	__m256d low01 = _mm256_unpacklo_pd(rows[0], rows[1]);
+	__m256d high01 = _mm256_unpackhi_pd(rows[0], rows[1]);
+	__m256d low23 = _mm256_unpacklo_pd(rows[2], rows[3]);
+	__m256d high23 = _mm256_unpackhi_pd(rows[2], rows[3]);
+
+	lanes[0] = _mm256_permute2f128_pd(low01, low23, 0x20);
+	lanes[1] = _mm256_permute2f128_pd(high01, high23, 0x20);
+	lanes[2] = _mm256_permute2f128_pd(low01, low23, 0x31);
+}
+#endif
+
+#endif
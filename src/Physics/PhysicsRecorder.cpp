@@ -0,0 +1,422 @@
+#include "PhysicsRecorder.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#include "../Logger/logger.h"
+
+// Stream layout, in native byte order:
+// header: Magic, Version, object count, soft object count and
+// sizeof(PhysicsScalar) as uint32_t;
+// per tick: double time step, uint32_t input count, the inputs and
+// the uint64_t state checksum after the step;
+// per input: uint8_t InputType, uint32_t object and vertex index and
+// the new value.
+static const uint32_t Magic = 0x43455250;
+static const uint32_t Version = 1;
+
+class StreamReader
+{
+public:
+	StreamReader(const std::vector<uint8_t>& stream) :
+		_stream(stream)
+	{
+		_offset = 0;
+	}
+
+	template<typename T>
+	bool Read(T& value)
+	{
+		return Read(&value, sizeof(T));
+	}
+
+	bool Read(void* data, size_t size)
+	{
+		if (_stream.size() - _offset < size) {
+			return false;
+		}
+
+		memcpy(data, _stream.data() + _offset, size);
+		_offset += size;
+
+		return true;
+	}
+
+	bool IsEnd() const
+	{
+		return _offset == _stream.size();
+	}
+
+private:
+	const std::vector<uint8_t>& _stream;
+	size_t _offset;
+};
+
+PhysicsRecorder::PhysicsRecorder(
+	PhysicalEngine* engine,
+	const std::vector<PhysicalObject*>& objects,
+	const std::vector<SoftObject*>& softObjects)
+{
+	_engine = engine;
+	_objects = objects;
+	_softObjects = softObjects;
+	_tickInputs = 0;
+
+	_engine->SetDeterministic(true);
+
+	for (PhysicalObject* object : _objects) {
+		Math::Mat<4>* external = object->PhysicalParams.ExternalMatrix;
+
+		_matrices.push_back(object->PhysicalParams.Matrix);
+		_externalMatrices.push_back(
+			external ? *external : Math::Mat<4>(1.0));
+	}
+
+	for (SoftObject* object : _softObjects) {
+		auto& vertexForces =
+			object->SoftPhysicsParams.Vertices.GetForces();
+
+		_forces.push_back(object->SoftPhysicsParams.Force);
+		_vertexForces.emplace_back(
+			vertexForces.begin(),
+			vertexForces.end());
+	}
+
+	Write(Magic);
+	Write(Version);
+	Write((uint32_t)_objects.size());
+	Write((uint32_t)_softObjects.size());
+	Write((uint32_t)sizeof(PhysicsScalar));
+}
+
+void PhysicsRecorder::Run(ThreadPool* threadPool, double timeStep)
+{
+	Write(timeStep);
+
+	size_t countOffset = _stream.size();
+	Write((uint32_t)0);
+
+	_tickInputs = 0;
+	RecordInputs();
+
+	uint32_t count = _tickInputs;
+	memcpy(_stream.data() + countOffset, &count, sizeof(count));
+
+	_engine->Run(threadPool, timeStep);
+
+	Write(GetChecksum(_objects, _softObjects));
+}
+
+void PhysicsRecorder::RecordInput(
+	InputType type,
+	uint32_t object,
+	uint32_t vertex,
+	const void* data,
+	size_t size)
+{
+	Write(type);
+	Write(object);
+	Write(vertex);
+
+	const uint8_t* bytes = (const uint8_t*)data;
+	_stream.insert(_stream.end(), bytes, bytes + size);
+
+	++_tickInputs;
+}
+
+void PhysicsRecorder::RecordInputs()
+{
+	for (uint32_t idx = 0; idx < _objects.size(); ++idx) {
+		const auto& params = _objects[idx]->PhysicalParams;
+		Math::Mat<4>& matrix = _matrices[idx];
+
+		bool matrixChanged = memcmp(
+			params.Matrix.Data,
+			matrix.Data,
+			sizeof(matrix.Data));
+
+		if (matrixChanged) {
+			matrix = params.Matrix;
+			RecordInput(
+				InputType::Matrix,
+				idx,
+				0,
+				matrix.Data,
+				sizeof(matrix.Data));
+		}
+
+		Math::Mat<4>* external = params.ExternalMatrix;
+		Math::Mat<4>& externalMatrix = _externalMatrices[idx];
+
+		bool externalChanged =
+			external &&
+			memcmp(
+				external->Data,
+				externalMatrix.Data,
+				sizeof(externalMatrix.Data));
+
+		if (externalChanged) {
+			externalMatrix = *external;
+			RecordInput(
+				InputType::ExternalMatrix,
+				idx,
+				0,
+				externalMatrix.Data,
+				sizeof(externalMatrix.Data));
+		}
+	}
+
+	for (uint32_t idx = 0; idx < _softObjects.size(); ++idx) {
+		auto& params = _softObjects[idx]->SoftPhysicsParams;
+		Math::Vec<3>& force = _forces[idx];
+
+		if (memcmp(params.Force.Data, force.Data, sizeof(force.Data))) {
+			force = params.Force;
+			RecordInput(
+				InputType::Force,
+				idx,
+				0,
+				force.Data,
+				sizeof(force.Data));
+		}
+
+		auto& vertexForces = params.Vertices.GetForces();
+		std::vector<PhysicsVec3>& lastForces = _vertexForces[idx];
+		uint32_t count = vertexForces.size();
+
+		lastForces.resize(count, PhysicsVec3(0.0));
+
+		for (uint32_t vertex = 0; vertex < count; ++vertex) {
+			bool changed = memcmp(
+				vertexForces[vertex].Data,
+				lastForces[vertex].Data,
+				sizeof(PhysicsVec3::Data));
+
+			if (changed) {
+				lastForces[vertex] = vertexForces[vertex];
+				RecordInput(
+					InputType::VertexForce,
+					idx,
+					vertex,
+					lastForces[vertex].Data,
+					sizeof(PhysicsVec3::Data));
+			}
+		}
+	}
+}
+
+bool PhysicsRecorder::Save(const std::string& fileName) const
+{
+	std::fstream file;
+	file.open(fileName, std::ios::out | std::ios::binary);
+
+	if (!file.is_open()) {
+		Logger::Error() << "Failed to open file " << fileName;
+		return false;
+	}
+
+	file.write((const char*)_stream.data(), _stream.size());
+	file.close();
+
+	return true;
+}
+
+bool PhysicsRecorder::Load(
+	const std::string& fileName,
+	std::vector<uint8_t>& stream)
+{
+	std::fstream file;
+	file.open(fileName, std::ios::in | std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		Logger::Error() << "Failed to open file " << fileName;
+		return false;
+	}
+
+	stream.resize(file.tellg());
+
+	file.seekg(0);
+	file.read((char*)stream.data(), stream.size());
+	file.close();
+
+	return true;
+}
+
+PhysicsRecorder::ReplayResult PhysicsRecorder::Replay(
+	const std::vector<uint8_t>& stream,
+	PhysicalEngine* engine,
+	const std::vector<PhysicalObject*>& objects,
+	const std::vector<SoftObject*>& softObjects,
+	ThreadPool* threadPool)
+{
+	ReplayResult result;
+	result.Ticks = 0;
+	result.FirstMismatch = UINT32_MAX;
+	result.RunSeconds = 0;
+
+	StreamReader reader(stream);
+	uint32_t header[5];
+
+	bool valid =
+		reader.Read(header, sizeof(header)) &&
+		header[0] == Magic &&
+		header[1] == Version &&
+		header[2] == objects.size() &&
+		header[3] == softObjects.size() &&
+		header[4] == sizeof(PhysicsScalar);
+
+	if (!valid) {
+		Logger::Error() << "Recording does not match the scene.";
+		return result;
+	}
+
+	engine->SetDeterministic(true);
+
+	while (!reader.IsEnd()) {
+		double timeStep;
+		uint32_t count;
+
+		valid = reader.Read(timeStep) && reader.Read(count);
+
+		for (uint32_t input = 0; valid && input < count; ++input) {
+			InputType type;
+			uint32_t object;
+			uint32_t vertex;
+
+			valid =
+				reader.Read(type) &&
+				reader.Read(object) &&
+				reader.Read(vertex);
+
+			if (!valid) {
+				break;
+			}
+
+			switch (type) {
+			case InputType::Matrix:
+			case InputType::ExternalMatrix: {
+				if (object >= objects.size()) {
+					valid = false;
+					break;
+				}
+
+				auto& params = objects[object]->PhysicalParams;
+				Math::Mat<4>* matrix = &params.Matrix;
+
+				if (type == InputType::ExternalMatrix) {
+					matrix = params.ExternalMatrix;
+				}
+
+				valid = matrix && reader.Read(
+					matrix->Data,
+					sizeof(matrix->Data));
+				break;
+			}
+			case InputType::Force: {
+				if (object >= softObjects.size()) {
+					valid = false;
+					break;
+				}
+
+				SoftObject* soft = softObjects[object];
+				auto& force = soft->SoftPhysicsParams.Force;
+
+				valid = reader.Read(
+					force.Data,
+					sizeof(force.Data));
+				break;
+			}
+			case InputType::VertexForce: {
+				if (object >= softObjects.size()) {
+					valid = false;
+					break;
+				}
+
+				auto& forces = softObjects[object]->
+					SoftPhysicsParams.Vertices.GetForces();
+
+				valid =
+					vertex < forces.size() &&
+					reader.Read(
+						forces[vertex].Data,
+						sizeof(PhysicsVec3::Data));
+				break;
+			}
+			default:
+				valid = false;
+				break;
+			}
+		}
+
+		uint64_t checksum;
+		valid = valid && reader.Read(checksum);
+
+		if (!valid) {
+			Logger::Error() << "Malformed recording at tick " <<
+				result.Ticks << ".";
+			break;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		engine->Run(threadPool, timeStep);
+		auto stop = std::chrono::high_resolution_clock::now();
+
+		result.RunSeconds +=
+			std::chrono::duration<double>(stop - start).count();
+
+		bool mismatch =
+			result.FirstMismatch == UINT32_MAX &&
+			GetChecksum(objects, softObjects) != checksum;
+
+		if (mismatch) {
+			result.FirstMismatch = result.Ticks;
+		}
+
+		++result.Ticks;
+	}
+
+	return result;
+}
+
+// 64 bit FNV-1a.
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+
+	for (size_t idx = 0; idx < size; ++idx) {
+		hash ^= bytes[idx];
+		hash *= 0x100000001b3;
+	}
+
+	return hash;
+}
+
+uint64_t PhysicsRecorder::GetChecksum(
+	const std::vector<PhysicalObject*>& objects,
+	const std::vector<SoftObject*>& softObjects)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+
+	for (PhysicalObject* object : objects) {
+		const Math::Mat<4>& matrix = object->PhysicalParams.Matrix;
+		hash = HashBytes(hash, matrix.Data, sizeof(matrix.Data));
+	}
+
+	for (SoftObject* object : softObjects) {
+		auto& vertices = object->SoftPhysicsParams.Vertices;
+		auto& positions = vertices.GetPositions();
+		auto& speeds = vertices.GetSpeeds();
+
+		hash = HashBytes(
+			hash,
+			positions.data(),
+			positions.size() * sizeof(PhysicsVec3));
+		hash = HashBytes(
+			hash,
+			speeds.data(),
+			speeds.size() * sizeof(PhysicsVec3));
+	}
+
+	return hash;
+}
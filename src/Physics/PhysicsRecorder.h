@@ -0,0 +1,105 @@
+#ifndef _PHYSICS_RECORDER_H
+#define _PHYSICS_RECORDER_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "PhysicalEngineBase.h"
+#include "PhysicalEngine.h"
+
+// Records the inputs gameplay code feeds into a PhysicalEngine tick by
+// tick, and replays them headless without waiting between ticks, for
+// regression and performance runs. Registered with the TimeEngine in
+// place of the engine, it records what changed before each step:
+// transforms of dynamic objects and forces of soft objects and their
+// vertices. A checksum of the state after each step is recorded too.
+// Objects are identified by their position in the lists given, so a
+// replay needs the same scene set up and registered in the same
+// order. Puts the engine into deterministic mode.
+class PhysicsRecorder : public PhysicalEngineBase
+{
+public:
+	struct ReplayResult
+	{
+		uint32_t Ticks;
+
+		// First tick whose state differs from the recording,
+		// UINT32_MAX if none does.
+		uint32_t FirstMismatch;
+
+		// Spent in PhysicalEngine::Run.
+		double RunSeconds;
+	};
+
+	PhysicsRecorder(
+		PhysicalEngine* engine,
+		const std::vector<PhysicalObject*>& objects,
+		const std::vector<SoftObject*>& softObjects);
+
+	void Run(ThreadPool* threadPool, double timeStep) override;
+
+	const std::vector<uint8_t>& GetStream() const
+	{
+		return _stream;
+	}
+
+	bool Save(const std::string& fileName) const;
+	static bool Load(
+		const std::string& fileName,
+		std::vector<uint8_t>& stream);
+
+	// Runs engine through all ticks of stream, applying the recorded
+	// inputs to the objects first. Stops at the end of the stream or
+	// at the first malformed tick.
+	static ReplayResult Replay(
+		const std::vector<uint8_t>& stream,
+		PhysicalEngine* engine,
+		const std::vector<PhysicalObject*>& objects,
+		const std::vector<SoftObject*>& softObjects,
+		ThreadPool* threadPool);
+
+	// Hash of soft vertex positions and speeds and object transforms.
+	static uint64_t GetChecksum(
+		const std::vector<PhysicalObject*>& objects,
+		const std::vector<SoftObject*>& softObjects);
+
+private:
+	enum class InputType : uint8_t
+	{
+		Matrix = 0,
+		ExternalMatrix = 1,
+		Force = 2,
+		VertexForce = 3
+	};
+
+	PhysicalEngine* _engine;
+	std::vector<PhysicalObject*> _objects;
+	std::vector<SoftObject*> _softObjects;
+
+	// Inputs as of the last recorded tick, to store only changes.
+	std::vector<Math::Mat<4>> _matrices;
+	std::vector<Math::Mat<4>> _externalMatrices;
+	std::vector<Math::Vec<3>> _forces;
+	std::vector<std::vector<PhysicsVec3>> _vertexForces;
+
+	std::vector<uint8_t> _stream;
+	size_t _tickInputs;
+
+	void RecordInput(
+		InputType type,
+		uint32_t object,
+		uint32_t vertex,
+		const void* data,
+		size_t size);
+	void RecordInputs();
+
+	template<typename T>
+	void Write(const T& value)
+	{
+		const uint8_t* bytes = (const uint8_t*)&value;
+		_stream.insert(_stream.end(), bytes, bytes + sizeof(T));
+	}
+};
+
+#endif
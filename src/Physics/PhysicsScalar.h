@@ -0,0 +1,17 @@
+#ifndef _PHYSICS_SCALAR_H
+#define _PHYSICS_SCALAR_H
+
+#include "../Math/vec.h"
+
+// Scalar type of per-vertex and per-triangle physics data. Building with
+// PHYSICS_SINGLE_PRECISION halves its memory traffic and doubles the
+// width of the triangle packets; engine interfaces stay in double.
+#ifdef PHYSICS_SINGLE_PRECISION
+typedef float PhysicsScalar;
+#else
+typedef double PhysicsScalar;
+#endif
+
+typedef Math::Vec<3, PhysicsScalar> PhysicsVec3;
+
+#endif
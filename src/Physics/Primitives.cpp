@@ -0,0 +1,504 @@
+#include "Primitives.h"
+
+#include <cmath>
+#include <utility>
+
+// Smallest root of a * t^2 + 2 * b * t + c = 0 for a ray entering a
+// quadric from outside (c > 0), if it is within [0, distance].
+static bool EnterQuadric(
+	double a,
+	double b,
+	double c,
+	double distance,
+	double& t)
+{
+	if (!(c > 0) || !(b < 0) || !(a > 0)) {
+		return false;
+	}
+
+	double discriminant = b * b - a * c;
+
+	if (discriminant < 0) {
+		return false;
+	}
+
+	t = (-b - sqrt(discriminant)) / a;
+
+	return t <= distance;
+}
+
+bool IntersectSphere(
+	double radius,
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double& distance,
+	Math::Vec<3>& normal)
+{
+	double t;
+
+	bool hit = EnterQuadric(
+		direction.Dot(direction),
+		source.Dot(direction),
+		source.Dot(source) - radius * radius,
+		distance,
+		t);
+
+	if (!hit) {
+		return false;
+	}
+
+	distance = t;
+	normal = (source + direction * t).Normalize();
+
+	return true;
+}
+
+bool IntersectBox(
+	const Math::Vec<3>& halfExtents,
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double& distance,
+	Math::Vec<3>& normal)
+{
+	double tMin = -INFINITY;
+	double tMax = distance;
+	int axis = -1;
+
+	for (int i = 0; i < 3; ++i) {
+		double invDir = 1.0 / direction[i];
+		double t1 = (-halfExtents[i] - source[i]) * invDir;
+		double t2 = (halfExtents[i] - source[i]) * invDir;
+
+		if (t1 > t2) {
+			std::swap(t1, t2);
+		}
+
+		if (t1 > tMin) {
+			tMin = t1;
+			axis = i;
+		}
+
+		if (t2 < tMax) {
+			tMax = t2;
+		}
+	}
+
+	// Entry behind the source means it starts inside.
+	if (axis < 0 || !(tMin >= 0) || !(tMin <= tMax)) {
+		return false;
+	}
+
+	distance = tMin;
+	normal = Math::Vec<3>(0.0);
+	normal[axis] = direction[axis] > 0 ? -1.0 : 1.0;
+
+	return true;
+}
+
+bool IntersectCapsule(
+	double radius,
+	double halfHeight,
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double& distance,
+	Math::Vec<3>& normal)
+{
+	// Inside test against the closest point on the axis.
+	double axisZ = std::fmax(-halfHeight, std::fmin(halfHeight, source[2]));
+	Math::Vec<3> offset = source - Math::Vec<3>({0, 0, axisZ});
+
+	if (!(offset.Dot(offset) > radius * radius)) {
+		return false;
+	}
+
+	bool hit = false;
+	double t;
+
+	bool side = EnterQuadric(
+		direction[0] * direction[0] + direction[1] * direction[1],
+		source[0] * direction[0] + source[1] * direction[1],
+		source[0] * source[0] + source[1] * source[1] -
+			radius * radius,
+		distance,
+		t);
+
+	if (side && fabs(source[2] + direction[2] * t) <= halfHeight) {
+		Math::Vec<3> point = source + direction * t;
+
+		distance = t;
+		normal = Math::Vec<3>({point[0], point[1], 0}).Normalize();
+		hit = true;
+	}
+
+	for (double capZ : {-halfHeight, halfHeight}) {
+		Math::Vec<3> capSource = source - Math::Vec<3>({0, 0, capZ});
+		Math::Vec<3> capNormal;
+
+		bool cap = IntersectSphere(
+			radius,
+			capSource,
+			direction,
+			distance,
+			capNormal);
+
+		if (cap) {
+			normal = capNormal;
+			hit = true;
+		}
+	}
+
+	return hit;
+}
+
+bool IntersectPlane(
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double& distance,
+	Math::Vec<3>& normal)
+{
+	if (!(source[2] > 0) || !(direction[2] < 0)) {
+		return false;
+	}
+
+	double t = -source[2] / direction[2];
+
+	if (!(t <= distance)) {
+		return false;
+	}
+
+	distance = t;
+	normal = Math::Vec<3>({0, 0, 1});
+
+	return true;
+}
+
+bool ClosestPointSphere(
+	double radius,
+	const Math::Vec<3>& point,
+	Math::Vec<3>& closest,
+	Math::Vec<3>& normal)
+{
+	double length = point.Length();
+
+	if (length > 0) {
+		normal = point / length;
+	} else {
+		normal = Math::Vec<3>({0, 0, 1});
+	}
+
+	closest = normal * radius;
+
+	return length < radius;
+}
+
+bool ClosestPointBox(
+	const Math::Vec<3>& halfExtents,
+	const Math::Vec<3>& point,
+	Math::Vec<3>& closest,
+	Math::Vec<3>& normal)
+{
+	bool inside = true;
+
+	for (int i = 0; i < 3; ++i) {
+		closest[i] = std::fmax(
+			-halfExtents[i],
+			std::fmin(halfExtents[i], point[i]));
+		inside &= closest[i] == point[i];
+	}
+
+	if (!inside) {
+		normal = (point - closest).Normalize();
+		return false;
+	}
+
+	// Inside points go out through the nearest face.
+	int axis = 0;
+	double depth = INFINITY;
+
+	for (int i = 0; i < 3; ++i) {
+		double faceDepth = halfExtents[i] - fabs(point[i]);
+
+		if (faceDepth < depth) {
+			depth = faceDepth;
+			axis = i;
+		}
+	}
+
+	normal = Math::Vec<3>(0.0);
+	normal[axis] = point[axis] < 0 ? -1.0 : 1.0;
+	closest[axis] = halfExtents[axis] * normal[axis];
+
+	return true;
+}
+
+bool ClosestPointCapsule(
+	double radius,
+	double halfHeight,
+	const Math::Vec<3>& point,
+	Math::Vec<3>& closest,
+	Math::Vec<3>& normal)
+{
+	double axisZ = std::fmax(-halfHeight, std::fmin(halfHeight, point[2]));
+	Math::Vec<3> axisPoint({0, 0, axisZ});
+	Math::Vec<3> offset = point - axisPoint;
+	double length = offset.Length();
+
+	if (length > 0) {
+		normal = offset / length;
+	} else {
+		normal = Math::Vec<3>({1, 0, 0});
+	}
+
+	closest = axisPoint + normal * radius;
+
+	return length < radius;
+}
+
+bool ClosestPointPlane(
+	const Math::Vec<3>& point,
+	Math::Vec<3>& closest,
+	Math::Vec<3>& normal)
+{
+	closest = Math::Vec<3>({point[0], point[1], 0});
+	normal = Math::Vec<3>({0, 0, 1});
+
+	return point[2] < 0;
+}
+
+// Region by region as in Ericson, Real-Time Collision Detection 5.1.5.
+Math::Vec<3> ClosestPointTriangle(
+	const Math::Vec<3>& v0,
+	const Math::Vec<3>& v1,
+	const Math::Vec<3>& v2,
+	const Math::Vec<3>& point)
+{
+	Math::Vec<3> edge1 = v1 - v0;
+	Math::Vec<3> edge2 = v2 - v0;
+
+	Math::Vec<3> offset0 = point - v0;
+	double d1 = edge1.Dot(offset0);
+	double d2 = edge2.Dot(offset0);
+
+	if (d1 <= 0 && d2 <= 0) {
+		return v0;
+	}
+
+	Math::Vec<3> offset1 = point - v1;
+	double d3 = edge1.Dot(offset1);
+	double d4 = edge2.Dot(offset1);
+
+	if (d3 >= 0 && d4 <= d3) {
+		return v1;
+	}
+
+	double c = d1 * d4 - d3 * d2;
+
+	if (c <= 0 && d1 >= 0 && d3 <= 0) {
+		return v0 + edge1 * (d1 / (d1 - d3));
+	}
+
+	Math::Vec<3> offset2 = point - v2;
+	double d5 = edge1.Dot(offset2);
+	double d6 = edge2.Dot(offset2);
+
+	if (d6 >= 0 && d5 <= d6) {
+		return v2;
+	}
+
+	double b = d5 * d2 - d1 * d6;
+
+	if (b <= 0 && d2 >= 0 && d6 <= 0) {
+		return v0 + edge2 * (d2 / (d2 - d6));
+	}
+
+	double a = d3 * d6 - d5 * d4;
+
+	if (a <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+		double w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		return v1 + (v2 - v1) * w;
+	}
+
+	double sum = a + b + c;
+
+	return v0 + edge1 * (b / sum) + edge2 * (c / sum);
+}
+
+// Separating axis test of the box against points projected on axis.
+static bool Separates(
+	const Math::Vec<3>& axis,
+	const Math::Vec<3>& halfExtents,
+	const Math::Vec<3>* points,
+	int count)
+{
+	double radius = 0;
+
+	for (int i = 0; i < 3; ++i) {
+		radius += halfExtents[i] * fabs(axis[i]);
+	}
+
+	double low = INFINITY;
+	double high = -INFINITY;
+
+	for (int i = 0; i < count; ++i) {
+		double projection = axis.Dot(points[i]);
+		low = std::fmin(low, projection);
+		high = std::fmax(high, projection);
+	}
+
+	return low > radius || high < -radius;
+}
+
+bool OverlapTriangleBox(
+	const Math::Vec<3>& v0,
+	const Math::Vec<3>& v1,
+	const Math::Vec<3>& v2,
+	const Math::Vec<3>& min,
+	const Math::Vec<3>& max)
+{
+	Math::Vec<3> center = (min + max) * 0.5;
+	Math::Vec<3> halfExtents = (max - min) * 0.5;
+
+	Math::Vec<3> points[3] = {v0 - center, v1 - center, v2 - center};
+	Math::Vec<3> edges[3] = {
+		points[1] - points[0],
+		points[2] - points[1],
+		points[0] - points[2]};
+
+	for (int i = 0; i < 3; ++i) {
+		Math::Vec<3> axis(0.0);
+		axis[i] = 1;
+
+		if (Separates(axis, halfExtents, points, 3)) {
+			return false;
+		}
+
+		for (int j = 0; j < 3; ++j) {
+			Math::Vec<3> cross = axis.Cross(edges[j]);
+
+			if (Separates(cross, halfExtents, points, 3)) {
+				return false;
+			}
+		}
+	}
+
+	Math::Vec<3> normal = edges[0].Cross(edges[1]);
+
+	return !Separates(normal, halfExtents, points, 3);
+}
+
+bool OverlapOrientedBox(
+	const Math::Vec<3>& center,
+	const Math::Vec<3> axes[3],
+	const Math::Vec<3>& min,
+	const Math::Vec<3>& max)
+{
+	Math::Vec<3> boxCenter = (min + max) * 0.5;
+	Math::Vec<3> halfExtents = (max - min) * 0.5;
+
+	Math::Vec<3> points[8];
+
+	for (int i = 0; i < 8; ++i) {
+		points[i] = center - boxCenter;
+
+		for (int j = 0; j < 3; ++j) {
+			points[i] += i & (1 << j) ? axes[j] : -axes[j];
+		}
+	}
+
+	// Face normals of both, and crosses of their edge directions.
+	for (int i = 0; i < 3; ++i) {
+		Math::Vec<3> axis(0.0);
+		axis[i] = 1;
+
+		if (Separates(axis, halfExtents, points, 8)) {
+			return false;
+		}
+
+		Math::Vec<3> face = axes[(i + 1) % 3].Cross(axes[(i + 2) % 3]);
+
+		if (Separates(face, halfExtents, points, 8)) {
+			return false;
+		}
+
+		for (int j = 0; j < 3; ++j) {
+			Math::Vec<3> cross = axis.Cross(axes[j]);
+
+			if (Separates(cross, halfExtents, points, 8)) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static double GetBoxDistanceSq(
+	const Math::Vec<3>& point,
+	const Math::Vec<3>& min,
+	const Math::Vec<3>& max)
+{
+	double distanceSq = 0;
+
+	for (int i = 0; i < 3; ++i) {
+		double outside = std::fmax(
+			0.0,
+			std::fmax(min[i] - point[i], point[i] - max[i]));
+		distanceSq += outside * outside;
+	}
+
+	return distanceSq;
+}
+
+bool OverlapCapsuleBox(
+	const Math::Vec<3>& start,
+	const Math::Vec<3>& end,
+	double radius,
+	const Math::Vec<3>& min,
+	const Math::Vec<3>& max)
+{
+	// The squared distance to the box is convex along the segment,
+	// its minimum is narrowed down by ternary search.
+	Math::Vec<3> segment = end - start;
+	double radiusSq = radius * radius;
+	double low = 0;
+	double high = 1;
+
+	for (int iteration = 0; iteration < 48; ++iteration) {
+		double first = low + (high - low) / 3;
+		double second = high - (high - low) / 3;
+
+		double firstSq =
+			GetBoxDistanceSq(start + segment * first, min, max);
+		double secondSq =
+			GetBoxDistanceSq(start + segment * second, min, max);
+
+		if (firstSq <= radiusSq || secondSq <= radiusSq) {
+			return true;
+		}
+
+		if (firstSq < secondSq) {
+			high = second;
+		} else {
+			low = first;
+		}
+	}
+
+	return
+		GetBoxDistanceSq(start, min, max) <= radiusSq ||
+		GetBoxDistanceSq(end, min, max) <= radiusSq;
+}
+
+bool OverlapPlaneBox(
+	const Math::Vec<3>& point,
+	const Math::Vec<3>& normal,
+	const Math::Vec<3>& min,
+	const Math::Vec<3>& max)
+{
+	Math::Vec<3> lowest;
+
+	for (int i = 0; i < 3; ++i) {
+		lowest[i] = normal[i] > 0 ? min[i] : max[i];
+	}
+
+	return normal.Dot(lowest - point) <= 0;
+}
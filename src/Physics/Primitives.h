@@ -0,0 +1,110 @@
+#ifndef _PRIMITIVES_H
+#define _PRIMITIVES_H
+
+#include "../Math/vec.h"
+
+// Ray tests against primitive shapes in their object space, for rays
+// source + direction * t with t in [0, distance]. On hit distance is
+// set to t and normal to the outward unit normal. Like back faces of
+// meshes, shapes are not hit by rays starting inside them.
+
+// Sphere of radius around the origin.
+bool IntersectSphere(
+	double radius,
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double& distance,
+	Math::Vec<3>& normal);
+
+// Box from -halfExtents to halfExtents.
+bool IntersectBox(
+	const Math::Vec<3>& halfExtents,
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double& distance,
+	Math::Vec<3>& normal);
+
+// Capsule around the segment from (0, 0, -halfHeight) to
+// (0, 0, halfHeight).
+bool IntersectCapsule(
+	double radius,
+	double halfHeight,
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double& distance,
+	Math::Vec<3>& normal);
+
+// Plane z = 0, solid below it.
+bool IntersectPlane(
+	const Math::Vec<3>& source,
+	const Math::Vec<3>& direction,
+	double& distance,
+	Math::Vec<3>& normal);
+
+// Nearest points on the surface of the same shapes to point, with the
+// outward unit normal there. Return true for points inside the shape.
+bool ClosestPointSphere(
+	double radius,
+	const Math::Vec<3>& point,
+	Math::Vec<3>& closest,
+	Math::Vec<3>& normal);
+
+bool ClosestPointBox(
+	const Math::Vec<3>& halfExtents,
+	const Math::Vec<3>& point,
+	Math::Vec<3>& closest,
+	Math::Vec<3>& normal);
+
+bool ClosestPointCapsule(
+	double radius,
+	double halfHeight,
+	const Math::Vec<3>& point,
+	Math::Vec<3>& closest,
+	Math::Vec<3>& normal);
+
+bool ClosestPointPlane(
+	const Math::Vec<3>& point,
+	Math::Vec<3>& closest,
+	Math::Vec<3>& normal);
+
+// Nearest point of the triangle to point.
+Math::Vec<3> ClosestPointTriangle(
+	const Math::Vec<3>& v0,
+	const Math::Vec<3>& v1,
+	const Math::Vec<3>& v2,
+	const Math::Vec<3>& point);
+
+// Overlap tests of shapes with the axis aligned box from min to max,
+// both given in the same space.
+bool OverlapTriangleBox(
+	const Math::Vec<3>& v0,
+	const Math::Vec<3>& v1,
+	const Math::Vec<3>& v2,
+	const Math::Vec<3>& min,
+	const Math::Vec<3>& max);
+
+// Parallelepiped center + sum of s[i] * axes[i] with s[i] in [-1, 1],
+// a box of any rotation and scale.
+bool OverlapOrientedBox(
+	const Math::Vec<3>& center,
+	const Math::Vec<3> axes[3],
+	const Math::Vec<3>& min,
+	const Math::Vec<3>& max);
+
+// Capsule around the segment from start to end, a sphere if they are
+// equal.
+bool OverlapCapsuleBox(
+	const Math::Vec<3>& start,
+	const Math::Vec<3>& end,
+	double radius,
+	const Math::Vec<3>& min,
+	const Math::Vec<3>& max);
+
+// Half space below the plane through point with the given normal.
+bool OverlapPlaneBox(
+	const Math::Vec<3>& point,
+	const Math::Vec<3>& normal,
+	const Math::Vec<3>& min,
+	const Math::Vec<3>& max);
+
+#endif
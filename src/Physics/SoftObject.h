@@ -2,31 +2,39 @@
 #define _SOFT_OBJECT_H
 
 #include <vector>
+#include <cstdint>
 
 #include "../Math/vec.h"
 #include "../Math/mat.h"
+#include "PhysicsScalar.h"
+#include "SoftVertexArray.h"
 
 class SoftObject
 {
 public:
 	struct SoftPhysicsValues
 	{
-		struct Vertex
-		{
-			double Mass;
-			double Mu;
-			double Bounciness;
-
-			Math::Vec<3> Position;
-			Math::Vec<3> Speed;
+		typedef SoftVertex Vertex;
+		typedef SoftVertexArray VertexArray;
 
-			Math::Vec<3> Force;
+		// Force integrates links as damped springs. The others
+		// solve them as XPBD distance constraints with compliance
+		// 1 / K and damping Friction, which stays stable at any K.
+		enum class SolverType
+		{
+			Force = 0,
+			GaussSeidel = 1,
+			Jacobi = 2
+		};
 
-			Vertex()
-			{
-				Speed = Math::Vec<3>(0.0);
-				Force = Math::Vec<3>(0.0);
-			}
+		// Ray casts one ray per vertex along its speed against
+		// physical objects. Sphere sweeps a sphere of SweepRadius
+		// instead, which also catches thin and grazing mesh triangles
+		// the ray passes between; other shapes still take the ray.
+		enum class SweepType
+		{
+			Ray = 0,
+			Sphere = 1
 		};
 
 		struct Link
@@ -34,15 +42,34 @@ public:
 			size_t Index1;
 			size_t Index2;
 
-			double Length;
-			double K;
-			double Friction;
+			PhysicsScalar Length;
+			PhysicsScalar K;
+			PhysicsScalar Friction;
 		};
 
-		std::vector<Vertex> Vertices;
+		VertexArray Vertices;
 		std::vector<Link> Links;
 
 		Math::Vec<3> Force;
+
+		SolverType Solver;
+		uint32_t SolverIterations;
+
+		SweepType Sweep;
+		double SweepRadius;
+
+		// Vertices of soft objects with SoftCollision keep
+		// CollisionRadius apart from vertices of other such objects,
+		// and from unlinked vertices of the same object with
+		// SelfCollision.
+		bool SoftCollision;
+		bool SelfCollision;
+		double CollisionRadius;
+
+		// Pairs with physical objects and other soft objects only
+		// if each one's Category shares a bit with the other's Mask.
+		uint32_t Category;
+		uint32_t Mask;
 	};
 
 	SoftPhysicsValues SoftPhysicsParams;
@@ -50,6 +77,15 @@ public:
 	SoftObject()
 	{
 		SoftPhysicsParams.Force = Math::Vec<3>(0.0);
+		SoftPhysicsParams.Solver = SoftPhysicsValues::SolverType::Force;
+		SoftPhysicsParams.SolverIterations = 10;
+		SoftPhysicsParams.Sweep = SoftPhysicsValues::SweepType::Ray;
+		SoftPhysicsParams.SweepRadius = 0.01;
+		SoftPhysicsParams.SoftCollision = false;
+		SoftPhysicsParams.SelfCollision = false;
+		SoftPhysicsParams.CollisionRadius = 0.02;
+		SoftPhysicsParams.Category = 1;
+		SoftPhysicsParams.Mask = UINT32_MAX;
 	}
 };
 
@@ -0,0 +1,283 @@
+#ifndef _SOFT_VERTEX_ARRAY_H
+#define _SOFT_VERTEX_ARRAY_H
+
+#include <vector>
+#include <optional>
+
+#include "../Math/vec.h"
+#include "PhysicsScalar.h"
+#include "../Utils/AlignedAllocator.h"
+
+struct SoftVertex
+{
+	double Mass;
+	double Mu;
+	double Bounciness;
+
+	Math::Vec<3> Position;
+	Math::Vec<3> Speed;
+
+	Math::Vec<3> Force;
+
+	SoftVertex()
+	{
+		Speed = Math::Vec<3>(0.0);
+		Force = Math::Vec<3>(0.0);
+	}
+};
+
+// Vertex storage with one contiguous 32 byte aligned array per field,
+// kept in PhysicsScalar precision.
+// Indexing returns a VertexRef that exposes the fields of SoftVertex
+// by reference, so element access looks the same as for a
+// std::vector<SoftVertex>.
+class SoftVertexArray
+{
+public:
+	template<typename T>
+	using Column = std::vector<T, AlignedAllocator<T, 32>>;
+
+	// Keeps inverse mass in sync on assignment.
+	class MassRef
+	{
+	public:
+		MassRef(PhysicsScalar& mass, PhysicsScalar& inverseMass) :
+			_mass(mass),
+			_inverseMass(inverseMass)
+		{ }
+
+		operator PhysicsScalar() const
+		{
+			return _mass;
+		}
+
+		MassRef& operator=(PhysicsScalar mass)
+		{
+			_mass = mass;
+			_inverseMass = 1.0 / mass;
+			return *this;
+		}
+
+		MassRef& operator=(const MassRef& mass)
+		{
+			return *this = (PhysicsScalar)mass;
+		}
+
+	private:
+		PhysicsScalar& _mass;
+		PhysicsScalar& _inverseMass;
+	};
+
+	struct VertexRef
+	{
+		MassRef Mass;
+		PhysicsScalar& Mu;
+		PhysicsScalar& Bounciness;
+
+		PhysicsVec3& Position;
+		PhysicsVec3& Speed;
+
+		PhysicsVec3& Force;
+
+		VertexRef(SoftVertexArray& array, size_t index) :
+			Mass(
+				array._mass[index],
+				array._inverseMass[index]),
+			Mu(array._mu[index]),
+			Bounciness(array._bounciness[index]),
+			Position(array._position[index]),
+			Speed(array._speed[index]),
+			Force(array._force[index])
+		{ }
+
+		VertexRef& operator=(const SoftVertex& vertex)
+		{
+			Mass = vertex.Mass;
+			Mu = vertex.Mu;
+			Bounciness = vertex.Bounciness;
+			Position = vertex.Position;
+			Speed = vertex.Speed;
+			Force = vertex.Force;
+
+			return *this;
+		}
+
+		operator SoftVertex() const
+		{
+			SoftVertex vertex;
+			vertex.Mass = Mass;
+			vertex.Mu = Mu;
+			vertex.Bounciness = Bounciness;
+			vertex.Position = Position;
+			vertex.Speed = Speed;
+			vertex.Force = Force;
+
+			return vertex;
+		}
+	};
+
+	class Iterator
+	{
+	public:
+		Iterator(SoftVertexArray* array, size_t index) :
+			_array(array),
+			_index(index)
+		{ }
+
+		Iterator(const Iterator& iterator) :
+			_array(iterator._array),
+			_index(iterator._index)
+		{ }
+
+		Iterator& operator=(const Iterator& iterator)
+		{
+			_array = iterator._array;
+			_index = iterator._index;
+			return *this;
+		}
+
+		VertexRef& operator*()
+		{
+			_ref.emplace(*_array, _index);
+			return *_ref;
+		}
+
+		VertexRef* operator->()
+		{
+			return &**this;
+		}
+
+		Iterator& operator++()
+		{
+			++_index;
+			return *this;
+		}
+
+		bool operator==(const Iterator& iterator) const
+		{
+			return _index == iterator._index;
+		}
+
+		bool operator!=(const Iterator& iterator) const
+		{
+			return _index != iterator._index;
+		}
+
+	private:
+		SoftVertexArray* _array;
+		size_t _index;
+		std::optional<VertexRef> _ref;
+	};
+
+	size_t size() const
+	{
+		return _position.size();
+	}
+
+	bool empty() const
+	{
+		return _position.empty();
+	}
+
+	void resize(size_t size)
+	{
+		_mass.resize(size, 0.0);
+		_inverseMass.resize(size, INFINITY);
+		_mu.resize(size, 0.0);
+		_bounciness.resize(size, 0.0);
+		_position.resize(size, PhysicsVec3(0.0));
+		_speed.resize(size, PhysicsVec3(0.0));
+		_force.resize(size, PhysicsVec3(0.0));
+	}
+
+	void reserve(size_t size)
+	{
+		_mass.reserve(size);
+		_inverseMass.reserve(size);
+		_mu.reserve(size);
+		_bounciness.reserve(size);
+		_position.reserve(size);
+		_speed.reserve(size);
+		_force.reserve(size);
+	}
+
+	void clear()
+	{
+		resize(0);
+	}
+
+	void push_back(const SoftVertex& vertex)
+	{
+		resize(size() + 1);
+		(*this)[size() - 1] = vertex;
+	}
+
+	VertexRef operator[](size_t index)
+	{
+		return VertexRef(*this, index);
+	}
+
+	SoftVertex operator[](size_t index) const
+	{
+		return VertexRef(
+			const_cast<SoftVertexArray&>(*this),
+			index);
+	}
+
+	Iterator begin()
+	{
+		return Iterator(this, 0);
+	}
+
+	Iterator end()
+	{
+		return Iterator(this, size());
+	}
+
+	Column<PhysicsScalar>& GetMasses()
+	{
+		return _mass;
+	}
+
+	Column<PhysicsScalar>& GetInverseMasses()
+	{
+		return _inverseMass;
+	}
+
+	Column<PhysicsScalar>& GetMus()
+	{
+		return _mu;
+	}
+
+	Column<PhysicsScalar>& GetBouncinesses()
+	{
+		return _bounciness;
+	}
+
+	Column<PhysicsVec3>& GetPositions()
+	{
+		return _position;
+	}
+
+	Column<PhysicsVec3>& GetSpeeds()
+	{
+		return _speed;
+	}
+
+	Column<PhysicsVec3>& GetForces()
+	{
+		return _force;
+	}
+
+private:
+	Column<PhysicsScalar> _mass;
+	Column<PhysicsScalar> _inverseMass;
+	Column<PhysicsScalar> _mu;
+	Column<PhysicsScalar> _bounciness;
+
+	Column<PhysicsVec3> _position;
+	Column<PhysicsVec3> _speed;
+	Column<PhysicsVec3> _force;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "SpatialHash.h"
+
+#include <algorithm>
+
+void SpatialHash::Build(
+	ThreadPool* threadPool,
+	const std::vector<PhysicsVec3>& points,
+	PhysicsScalar cellSize)
+{
+	uint32_t count = points.size();
+	uint32_t bucketCount = 1;
+
+	while (bucketCount < count * 2) {
+		bucketCount *= 2;
+	}
+
+	_inverseCellSize = 1 / cellSize;
+	_mask = bucketCount - 1;
+
+	_cells.resize(count);
+	_pointBuckets.resize(count);
+	_buckets.assign(bucketCount + 1, 0);
+	_points.resize(count);
+
+	uint32_t* buckets = _buckets.data();
+
+	threadPool->ParallelFor(
+		count,
+		PointChunkSize,
+		[this, &points, buckets](size_t begin, size_t end) -> void
+		{
+			for (size_t idx = begin; idx < end; ++idx) {
+				Cell cell = GetCell(points[idx]);
+				uint32_t bucket = GetBucket(cell);
+
+				_cells[idx] = cell;
+				_pointBuckets[idx] = bucket;
+
+				__atomic_fetch_add(
+					&buckets[bucket + 1],
+					1,
+					__ATOMIC_RELAXED);
+			}
+		});
+
+	for (uint32_t bucket = 0; bucket < bucketCount; ++bucket) {
+		_buckets[bucket + 1] += _buckets[bucket];
+	}
+
+	_cursors.assign(_buckets.begin(), _buckets.end() - 1);
+	uint32_t* cursors = _cursors.data();
+
+	threadPool->ParallelFor(
+		count,
+		PointChunkSize,
+		[this, cursors](size_t begin, size_t end) -> void
+		{
+			for (size_t idx = begin; idx < end; ++idx) {
+				uint32_t slot = __atomic_fetch_add(
+					&cursors[_pointBuckets[idx]],
+					1,
+					__ATOMIC_RELAXED);
+
+				_points[slot] = idx;
+			}
+		});
+
+	// Restore the index order lost in the parallel scatter.
+	threadPool->ParallelFor(
+		bucketCount,
+		PointChunkSize,
+		[this](size_t begin, size_t end) -> void
+		{
+			for (size_t bucket = begin; bucket < end; ++bucket) {
+				std::sort(
+					_points.begin() + _buckets[bucket],
+					_points.begin() + _buckets[bucket + 1]);
+			}
+		});
+}
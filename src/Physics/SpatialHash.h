@@ -0,0 +1,115 @@
+#ifndef _SPATIAL_HASH_H
+#define _SPATIAL_HASH_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+#include "PhysicsScalar.h"
+#include "../Utils/ThreadPool.h"
+
+// Uniform grid over points, hashed into a table about twice the point
+// count. Points are counting sorted into buckets, ordered by index
+// within a bucket so that queries visit them in a fixed order.
+class SpatialHash
+{
+public:
+	void Build(
+		ThreadPool* threadPool,
+		const std::vector<PhysicsVec3>& points,
+		PhysicsScalar cellSize);
+
+	// Calls visit(index) for every point in the 3x3x3 cells around
+	// point. Finds all points closer than the cell size.
+	template<typename Visit>
+	void Query(const PhysicsVec3& point, Visit visit) const
+	{
+		if (_buckets.empty()) {
+			return;
+		}
+
+		Cell center = GetCell(point);
+
+		for (int32_t dx = -1; dx <= 1; ++dx) {
+			for (int32_t dy = -1; dy <= 1; ++dy) {
+				for (int32_t dz = -1; dz <= 1; ++dz) {
+					Cell cell = {
+						center.X + dx,
+						center.Y + dy,
+						center.Z + dz
+					};
+
+					VisitCell(cell, visit);
+				}
+			}
+		}
+	}
+
+private:
+	static const size_t PointChunkSize = 4096;
+
+	struct Cell
+	{
+		int32_t X;
+		int32_t Y;
+		int32_t Z;
+
+		bool operator==(const Cell& cell) const
+		{
+			return X == cell.X && Y == cell.Y && Z == cell.Z;
+		}
+	};
+
+	PhysicsScalar _inverseCellSize;
+	uint32_t _mask;
+
+	std::vector<Cell> _cells;
+	std::vector<uint32_t> _pointBuckets;
+
+	// Points of bucket b are
+	// _points[_buckets[b] .. _buckets[b + 1]).
+	std::vector<uint32_t> _buckets;
+	std::vector<uint32_t> _points;
+	std::vector<uint32_t> _cursors;
+
+	Cell GetCell(const PhysicsVec3& point) const
+	{
+		return {
+			(int32_t)floor(point[0] * _inverseCellSize),
+			(int32_t)floor(point[1] * _inverseCellSize),
+			(int32_t)floor(point[2] * _inverseCellSize)
+		};
+	}
+
+	uint32_t GetBucket(const Cell& cell) const
+	{
+		uint32_t hash =
+			((uint32_t)cell.X * 73856093u) ^
+			((uint32_t)cell.Y * 19349663u) ^
+			((uint32_t)cell.Z * 83492791u);
+
+		return hash & _mask;
+	}
+
+	// Buckets are shared by several cells, points of other cells
+	// are skipped.
+	template<typename Visit>
+	void VisitCell(const Cell& cell, Visit& visit) const
+	{
+		uint32_t bucket = GetBucket(cell);
+
+		for (
+			uint32_t idx = _buckets[bucket];
+			idx < _buckets[bucket + 1];
+			++idx)
+		{
+			uint32_t point = _points[idx];
+
+			if (_cells[point] == cell) {
+				visit(point);
+			}
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,422 @@
+#include "TrianglePacket.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "PhysicsLanes.h"
+
+// Both implementations follow the Cramer's rule solution of
+// u * edge1 + v * edge2 - t * direction = source - v0
+// used by the scalar triangle test, with conditions written so that
+// NaN results are treated as misses.
+
+static const PhysicsScalar Epsilon = 0.00000001;
+
+static inline PhysicsScalar Det3(
+	PhysicsScalar c00, PhysicsScalar c01, PhysicsScalar c02,
+	PhysicsScalar c10, PhysicsScalar c11, PhysicsScalar c12,
+	PhysicsScalar c20, PhysicsScalar c21, PhysicsScalar c22)
+{
+	return
+		c00 * c11 * c22 -
+		c00 * c12 * c21 -
+		c01 * c10 * c22 +
+		c01 * c12 * c20 +
+		c02 * c10 * c21 -
+		c02 * c11 * c20;
+}
+
+static uint32_t IntersectScalar(
+	const TrianglePacket& packet,
+	const PhysicsVec3& source,
+	const PhysicsVec3& direction,
+	PhysicsScalar distance,
+	PhysicsScalar* distances)
+{
+	uint32_t mask = 0;
+
+	PhysicsScalar nd0 = -direction[0];
+	PhysicsScalar nd1 = -direction[1];
+	PhysicsScalar nd2 = -direction[2];
+
+	for (int lane = 0; lane < TrianglePacket::Width; ++lane) {
+		PhysicsScalar e10 = packet.Edge1[0][lane];
+		PhysicsScalar e11 = packet.Edge1[1][lane];
+		PhysicsScalar e12 = packet.Edge1[2][lane];
+
+		PhysicsScalar e20 = packet.Edge2[0][lane];
+		PhysicsScalar e21 = packet.Edge2[1][lane];
+		PhysicsScalar e22 = packet.Edge2[2][lane];
+
+		PhysicsScalar det = Det3(
+			e10, e11, e12,
+			e20, e21, e22,
+			nd0, nd1, nd2);
+
+		if (!(det <= -Epsilon || det >= Epsilon)) {
+			continue;
+		}
+
+		PhysicsScalar b0 = source[0] - packet.V0[0][lane];
+		PhysicsScalar b1 = source[1] - packet.V0[1][lane];
+		PhysicsScalar b2 = source[2] - packet.V0[2][lane];
+
+		PhysicsScalar u = Det3(
+			b0, b1, b2,
+			e20, e21, e22,
+			nd0, nd1, nd2) / det;
+
+		if (!(u >= 0 && u <= 1)) {
+			continue;
+		}
+
+		PhysicsScalar v = Det3(
+			e10, e11, e12,
+			b0, b1, b2,
+			nd0, nd1, nd2) / det;
+
+		if (!(v >= 0 && u + v <= 1)) {
+			continue;
+		}
+
+		PhysicsScalar t = Det3(
+			e10, e11, e12,
+			e20, e21, e22,
+			b0, b1, b2) / det;
+
+		if (!(t >= 0 && t <= distance)) {
+			continue;
+		}
+
+		distances[lane] = t;
+		mask |= 1 << lane;
+	}
+
+	return mask;
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline Lanes Det3AVX2(
+	Lanes c00, Lanes c01, Lanes c02,
+	Lanes c10, Lanes c11, Lanes c12,
+	Lanes c20, Lanes c21, Lanes c22)
+{
+	Lanes res = LanesMul(LanesMul(c00, c11), c22);
+	res = LanesSub(
+		res,
+		LanesMul(LanesMul(c00, c12), c21));
+	res = LanesSub(
+		res,
+		LanesMul(LanesMul(c01, c10), c22));
+	res = LanesAdd(
+		res,
+		LanesMul(LanesMul(c01, c12), c20));
+	res = LanesAdd(
+		res,
+		LanesMul(LanesMul(c02, c10), c21));
+	res = LanesSub(
+		res,
+		LanesMul(LanesMul(c02, c11), c20));
+
+	return res;
+}
+
+__attribute__((target("avx2")))
+static uint32_t IntersectAVX2(
+	const TrianglePacket& packet,
+	const PhysicsVec3& source,
+	const PhysicsVec3& direction,
+	PhysicsScalar distance,
+	PhysicsScalar* distances)
+{
+	Lanes e10 = LanesLoad(packet.Edge1[0]);
+	Lanes e11 = LanesLoad(packet.Edge1[1]);
+	Lanes e12 = LanesLoad(packet.Edge1[2]);
+
+	Lanes e20 = LanesLoad(packet.Edge2[0]);
+	Lanes e21 = LanesLoad(packet.Edge2[1]);
+	Lanes e22 = LanesLoad(packet.Edge2[2]);
+
+	Lanes nd0 = LanesSet(-direction[0]);
+	Lanes nd1 = LanesSet(-direction[1]);
+	Lanes nd2 = LanesSet(-direction[2]);
+
+	Lanes zero = LanesZero();
+	Lanes one = LanesSet(1.0);
+
+	Lanes det = Det3AVX2(
+		e10, e11, e12,
+		e20, e21, e22,
+		nd0, nd1, nd2);
+
+	Lanes valid = LanesOr(
+		LanesCmp(det, LanesSet(-Epsilon), _CMP_LE_OQ),
+		LanesCmp(det, LanesSet(Epsilon), _CMP_GE_OQ));
+
+	if (LanesMask(valid) == 0) {
+		return 0;
+	}
+
+	Lanes b0 = LanesSub(
+		LanesSet(source[0]),
+		LanesLoad(packet.V0[0]));
+	Lanes b1 = LanesSub(
+		LanesSet(source[1]),
+		LanesLoad(packet.V0[1]));
+	Lanes b2 = LanesSub(
+		LanesSet(source[2]),
+		LanesLoad(packet.V0[2]));
+
+	Lanes u = LanesDiv(
+		Det3AVX2(
+			b0, b1, b2,
+			e20, e21, e22,
+			nd0, nd1, nd2),
+		det);
+
+	Lanes v = LanesDiv(
+		Det3AVX2(
+			e10, e11, e12,
+			b0, b1, b2,
+			nd0, nd1, nd2),
+		det);
+
+	Lanes t = LanesDiv(
+		Det3AVX2(
+			e10, e11, e12,
+			e20, e21, e22,
+			b0, b1, b2),
+		det);
+
+	valid = LanesAnd(valid, LanesCmp(u, zero, _CMP_GE_OQ));
+	valid = LanesAnd(valid, LanesCmp(u, one, _CMP_LE_OQ));
+	valid = LanesAnd(valid, LanesCmp(v, zero, _CMP_GE_OQ));
+	valid = LanesAnd(
+		valid,
+		LanesCmp(LanesAdd(u, v), one, _CMP_LE_OQ));
+	valid = LanesAnd(valid, LanesCmp(t, zero, _CMP_GE_OQ));
+	valid = LanesAnd(
+		valid,
+		LanesCmp(t, LanesSet(distance), _CMP_LE_OQ));
+
+	LanesStore(distances, t);
+
+	return LanesMask(valid);
+}
+
+typedef uint32_t (*PacketFunction)(
+	const TrianglePacket& packet,
+	const PhysicsVec3& source,
+	const PhysicsVec3& direction,
+	PhysicsScalar distance,
+	PhysicsScalar* distances);
+
+static PacketFunction SelectPacketFunction()
+{
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		return IntersectAVX2;
+	}
+
+	return IntersectScalar;
+}
+
+uint32_t IntersectTrianglePacket(
+	const TrianglePacket& packet,
+	const PhysicsVec3& source,
+	const PhysicsVec3& direction,
+	PhysicsScalar distance,
+	PhysicsScalar* distances)
+{
+	static const PacketFunction function = SelectPacketFunction();
+	return function(packet, source, direction, distance, distances);
+}
+
+// Entry distance of the ray into a sphere, 0 if it starts inside.
+static bool SweepCorner(
+	const PhysicsVec3& source,
+	const PhysicsVec3& direction,
+	const PhysicsVec3& corner,
+	PhysicsScalar radius,
+	PhysicsScalar& t)
+{
+	PhysicsVec3 m = source - corner;
+	PhysicsScalar c = m.Dot(m) - radius * radius;
+
+	if (c <= 0) {
+		t = 0;
+		return true;
+	}
+
+	PhysicsScalar a = direction.Dot(direction);
+	PhysicsScalar b = m.Dot(direction);
+	PhysicsScalar disc = b * b - a * c;
+
+	if (!(b < 0 && disc >= 0)) {
+		return false;
+	}
+
+	t = (-b - sqrt(disc)) / a;
+	return true;
+}
+
+// Entry distance of the ray into the cylinder around the edge, only
+// where it lies between the edge ends. Rays along the edge are left
+// to the corners.
+static bool SweepEdge(
+	const PhysicsVec3& source,
+	const PhysicsVec3& direction,
+	const PhysicsVec3& start,
+	const PhysicsVec3& edge,
+	PhysicsScalar radius,
+	PhysicsScalar& t)
+{
+	PhysicsVec3 m = source - start;
+
+	PhysicsScalar ee = edge.Dot(edge);
+	PhysicsScalar me = m.Dot(edge);
+	PhysicsScalar de = direction.Dot(edge);
+
+	PhysicsScalar a = ee * direction.Dot(direction) - de * de;
+	PhysicsScalar b = ee * m.Dot(direction) - de * me;
+	PhysicsScalar c = ee * (m.Dot(m) - radius * radius) - me * me;
+
+	if (c <= 0) {
+		t = 0;
+		return me >= 0 && me <= ee;
+	}
+
+	PhysicsScalar disc = b * b - a * c;
+
+	if (!(a > Epsilon * ee && b < 0 && disc >= 0)) {
+		return false;
+	}
+
+	t = (-b - sqrt(disc)) / a;
+
+	PhysicsScalar s = me + t * de;
+	return s >= 0 && s <= ee;
+}
+
+static bool SweepTriangle(
+	const PhysicsVec3& source,
+	const PhysicsVec3& direction,
+	const PhysicsVec3 corners[3],
+	PhysicsScalar radius,
+	PhysicsScalar& t)
+{
+	PhysicsVec3 edges[3] = {
+		corners[1] - corners[0],
+		corners[2] - corners[1],
+		corners[0] - corners[2]};
+
+	PhysicsVec3 faceNormal = edges[0].Cross(corners[2] - corners[0]);
+	PhysicsScalar area = faceNormal.Length();
+
+	// The first touch of the face plane is the first touch of the
+	// triangle if it lands inside, otherwise an edge or a corner is
+	// touched first.
+	if (area > Epsilon) {
+		PhysicsVec3 normal = faceNormal / area;
+		PhysicsScalar height = normal.Dot(source - corners[0]);
+
+		if (height < 0) {
+			normal = -normal;
+			height = -height;
+		}
+
+		PhysicsScalar approach = -normal.Dot(direction);
+
+		if (height > radius && !(approach > 0)) {
+			return false;
+		}
+
+		PhysicsScalar plane = 0;
+
+		if (height > radius) {
+			plane = (height - radius) / approach;
+		}
+
+		PhysicsVec3 point = source + direction * plane;
+		bool inside = true;
+
+		for (int i = 0; i < 3; ++i) {
+			PhysicsVec3 side = edges[i].Cross(point - corners[i]);
+			inside &= side.Dot(faceNormal) >= 0;
+		}
+
+		if (inside) {
+			t = plane;
+			return true;
+		}
+	}
+
+	PhysicsScalar nearest = INFINITY;
+
+	for (int i = 0; i < 3; ++i) {
+		PhysicsScalar edgeT;
+		PhysicsScalar cornerT;
+
+		bool edgeHit = SweepEdge(
+			source,
+			direction,
+			corners[i],
+			edges[i],
+			radius,
+			edgeT);
+
+		if (edgeHit) {
+			nearest = std::min(nearest, edgeT);
+		}
+
+		bool cornerHit = SweepCorner(
+			source,
+			direction,
+			corners[i],
+			radius,
+			cornerT);
+
+		if (cornerHit) {
+			nearest = std::min(nearest, cornerT);
+		}
+	}
+
+	t = nearest;
+	return nearest < INFINITY;
+}
+
+uint32_t SweepSpherePacket(
+	const TrianglePacket& packet,
+	const PhysicsVec3& source,
+	const PhysicsVec3& direction,
+	PhysicsScalar radius,
+	PhysicsScalar distance,
+	PhysicsScalar* distances)
+{
+	uint32_t mask = 0;
+
+	for (int lane = 0; lane < TrianglePacket::Width; ++lane) {
+		if (packet.Triangles[lane] == TrianglePacket::EmptyLane) {
+			continue;
+		}
+
+		PhysicsVec3 corners[3];
+		packet.GetCorners(lane, corners);
+
+		PhysicsScalar t;
+
+		if (!SweepTriangle(source, direction, corners, radius, t)) {
+			continue;
+		}
+
+		if (!(t <= distance)) {
+			continue;
+		}
+
+		distances[lane] = t;
+		mask |= 1 << lane;
+	}
+
+	return mask;
+}
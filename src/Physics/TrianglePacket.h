@@ -0,0 +1,58 @@
+#ifndef _TRIANGLE_PACKET_H
+#define _TRIANGLE_PACKET_H
+
+#include <cstdint>
+
+#include "../Math/vec.h"
+#include "PhysicsScalar.h"
+
+// Up to Width triangles stored as structure of arrays, so that one ray
+// can be tested against all of them at once. Width fills one 256 bit
+// register. Unused lanes hold degenerate triangles and EmptyLane as
+// triangle number.
+struct alignas(32) TrianglePacket
+{
+	static const int Width = 32 / sizeof(PhysicsScalar);
+	static const uint32_t EmptyLane = UINT32_MAX;
+
+	PhysicsScalar V0[3][Width];
+	PhysicsScalar Edge1[3][Width];
+	PhysicsScalar Edge2[3][Width];
+
+	uint32_t Triangles[Width];
+
+	void GetCorners(int lane, PhysicsVec3 corners[3]) const
+	{
+		for (int i = 0; i < 3; ++i) {
+			corners[0][i] = V0[i][lane];
+			corners[1][i] = V0[i][lane] + Edge1[i][lane];
+			corners[2][i] = V0[i][lane] + Edge2[i][lane];
+		}
+	}
+};
+
+// Tests the ray against every lane of the packet. Returns a bit mask of
+// lanes hit within distance and writes hit distances for those lanes.
+// Uses AVX2 when the CPU supports it, scalar code otherwise; both paths
+// evaluate the same expressions in the same order.
+uint32_t IntersectTrianglePacket(
+	const TrianglePacket& packet,
+	const PhysicsVec3& source,
+	const PhysicsVec3& direction,
+	PhysicsScalar distance,
+	PhysicsScalar* distances);
+
+// Sweeps a sphere of radius along the ray against every lane of the
+// packet, with the same mask and distances as IntersectTrianglePacket.
+// Distances are those of the sphere center at first contact with the
+// face, an edge or a corner of the triangle, 0 for lanes the sphere
+// already touches. Both sides of the triangles are hit. Scalar code.
+uint32_t SweepSpherePacket(
+	const TrianglePacket& packet,
+	const PhysicsVec3& source,
+	const PhysicsVec3& direction,
+	PhysicsScalar radius,
+	PhysicsScalar distance,
+	PhysicsScalar* distances);
+
+#endif
@@ -0,0 +1,51 @@
+#include "rwlock.h"
+
+#include <stdexcept>
+
+#include "../Logger/logger.h"
+
+Sync::RWLock::RWLock()
+{
+	pthread_rwlock_init(&_lock, nullptr);
+}
+
+Sync::RWLock::~RWLock()
+{
+	int err = pthread_rwlock_destroy(&_lock);
+
+	if (err) {
+		Logger::Error() << "Attempt to delete locked rwlock.";
+	}
+}
+
+void Sync::RWLock::Lock()
+{
+	int err = pthread_rwlock_wrlock(&_lock);
+
+	if (err) {
+		throw std::runtime_error("Failed to lock rwlock.");
+	}
+}
+
+void Sync::RWLock::Unlock()
+{
+	int err = pthread_rwlock_unlock(&_lock);
+
+	if (err) {
+		throw std::runtime_error("Failed to unlock rwlock.");
+	}
+}
+
+void Sync::RWLock::LockShared()
+{
+	int err = pthread_rwlock_rdlock(&_lock);
+
+	if (err) {
+		throw std::runtime_error("Failed to lock rwlock for reading.");
+	}
+}
+
+void Sync::RWLock::UnlockShared()
+{
+	Unlock();
+}
@@ -0,0 +1,28 @@
+#ifndef _RWLOCK_H
+#define _RWLOCK_H
+
+#include <pthread.h>
+
+namespace Sync
+{
+	class RWLock
+	{
+	public:
+		RWLock();
+		~RWLock();
+
+		RWLock(const RWLock& lock) = delete;
+		RWLock& operator=(const RWLock& lock) = delete;
+
+		void Lock();
+		void Unlock();
+
+		void LockShared();
+		void UnlockShared();
+
+	private:
+		pthread_rwlock_t _lock;
+	};
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef _ALIGNED_ALLOCATOR_H
+#define _ALIGNED_ALLOCATOR_H
+
+#include <new>
+#include <cstddef>
+
+template<typename T, size_t Alignment>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+
+	template<typename U>
+	struct rebind
+	{
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	AlignedAllocator()
+	{ }
+
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>& allocator)
+	{ }
+
+	T* allocate(size_t count)
+	{
+		return static_cast<T*>(::operator new(
+			count * sizeof(T),
+			std::align_val_t(Alignment)));
+	}
+
+	void deallocate(T* pointer, size_t count)
+	{
+		::operator delete(pointer, std::align_val_t(Alignment));
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>& allocator) const
+	{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>& allocator) const
+	{
+		return false;
+	}
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef _MPSC_QUEUE_H
+#define _MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// Unbounded lock-free queue for many producers and one consumer.
+// Producers push onto a linked stack; the consumer takes the whole
+// stack at once and visits it in push order.
+template<typename T>
+class MPSCQueue
+{
+public:
+	MPSCQueue()
+	{
+		_head = nullptr;
+	}
+
+	~MPSCQueue()
+	{
+		Drain([](T& value) -> void { });
+	}
+
+	MPSCQueue(const MPSCQueue& queue) = delete;
+	MPSCQueue& operator=(const MPSCQueue& queue) = delete;
+
+	void Push(T&& value)
+	{
+		Node* node = new Node{std::move(value), nullptr};
+		node->Next = _head.load(std::memory_order_relaxed);
+
+		while (!_head.compare_exchange_weak(
+			node->Next,
+			node,
+			std::memory_order_release,
+			std::memory_order_relaxed))
+		{ }
+	}
+
+	// Consumer side only. visit(value) is called for every value
+	// pushed before the call, oldest first.
+	template<typename Visit>
+	void Drain(Visit visit)
+	{
+		Node* node = _head.exchange(nullptr, std::memory_order_acquire);
+		Node* reversed = nullptr;
+
+		while (node) {
+			Node* next = node->Next;
+			node->Next = reversed;
+			reversed = node;
+			node = next;
+		}
+
+		while (reversed) {
+			Node* next = reversed->Next;
+			visit(reversed->Value);
+			delete reversed;
+			reversed = next;
+		}
+	}
+
+private:
+	struct Node
+	{
+		T Value;
+		Node* Next;
+	};
+
+	std::atomic<Node*> _head;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef _SLOT_MAP_H
+#define _SLOT_MAP_H
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+// Values stored densely in insertion order with holes filled by the
+// last value on removal, addressed by handles that stay valid until
+// their value is removed. Handle is a struct with uint32_t Index and
+// Generation fields; a removed value's handle is recognized as stale
+// by its generation. Insert, Remove and Get are O(1). A handle can be
+// reserved ahead of inserting its value, Get returns nullptr for it
+// until then.
+template<typename T, typename Handle>
+class SlotMap
+{
+public:
+	SlotMap()
+	{
+		_freeSlot = NoSlot;
+	}
+
+	Handle Reserve()
+	{
+		uint32_t slot;
+
+		if (_freeSlot != NoSlot) {
+			slot = _freeSlot;
+			_freeSlot = _slots[slot].Position;
+		} else {
+			slot = _slots.size();
+			_slots.push_back({0, 0});
+		}
+
+		_slots[slot].Position = NoSlot;
+
+		Handle handle;
+		handle.Index = slot;
+		handle.Generation = _slots[slot].Generation;
+
+		return handle;
+	}
+
+	// Stores the value of a reserved handle.
+	void Insert(const Handle& handle, T&& value)
+	{
+		_slots[handle.Index].Position = _values.size();
+		_values.push_back(std::move(value));
+		_valueSlots.push_back(handle.Index);
+	}
+
+	Handle Insert(T&& value)
+	{
+		Handle handle = Reserve();
+		Insert(handle, std::move(value));
+
+		return handle;
+	}
+
+	// Returns false for stale handles.
+	bool Remove(const Handle& handle)
+	{
+		if (!Contains(handle)) {
+			return false;
+		}
+
+		Slot& slot = _slots[handle.Index];
+
+		if (slot.Position != NoSlot) {
+			uint32_t last = _values.size() - 1;
+
+			if (slot.Position != last) {
+				_values[slot.Position] =
+					std::move(_values[last]);
+				_valueSlots[slot.Position] = _valueSlots[last];
+				_slots[_valueSlots[last]].Position =
+					slot.Position;
+			}
+
+			_values.pop_back();
+			_valueSlots.pop_back();
+		}
+
+		++slot.Generation;
+		slot.Position = _freeSlot;
+		_freeSlot = handle.Index;
+
+		return true;
+	}
+
+	bool Contains(const Handle& handle) const
+	{
+		return
+			handle.Index < _slots.size() &&
+			_slots[handle.Index].Generation == handle.Generation;
+	}
+
+	// nullptr for stale handles and those without a value yet.
+	T* Get(const Handle& handle)
+	{
+		if (!Contains(handle)) {
+			return nullptr;
+		}
+
+		if (_slots[handle.Index].Position == NoSlot) {
+			return nullptr;
+		}
+
+		return &_values[_slots[handle.Index].Position];
+	}
+
+	// Handle of the value at a position of GetValues, for records
+	// that must outlive a reordering.
+	Handle GetHandle(size_t position) const
+	{
+		Handle handle;
+		handle.Index = _valueSlots[position];
+		handle.Generation = _slots[handle.Index].Generation;
+
+		return handle;
+	}
+
+	// Values in dense order, for iteration by position. Positions
+	// change on removal.
+	std::vector<T>& GetValues()
+	{
+		return _values;
+	}
+
+	const std::vector<T>& GetValues() const
+	{
+		return _values;
+	}
+
+private:
+	static const uint32_t NoSlot = UINT32_MAX;
+
+	// Position of the value for used slots, NoSlot for reserved ones
+	// and the next free slot for free ones. Generation is bumped on
+	// removal.
+	struct Slot
+	{
+		uint32_t Position;
+		uint32_t Generation;
+	};
+
+	std::vector<T> _values;
+	std::vector<uint32_t> _valueSlots;
+	std::vector<Slot> _slots;
+	uint32_t _freeSlot;
+};
+
+#endif
@@ -1,7 +1,13 @@
 #include "ThreadPool.h"
 
+#include <atomic>
+#include <memory>
+
 #include "../Logger/logger.h"
 
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local uint32_t currentWorkerIndex = 0;
+
 ThreadPool::ThreadPool() :
 	_queueSemaphore(0),
 	_resultSemaphore(0)
@@ -54,7 +60,8 @@ void ThreadPool::StartThreads(uint32_t threadCount)
 	for (size_t i = 0; i < _threads.size(); ++i) {
 		_threads[i] = new std::thread(
 			&ThreadPool::ThreadFunction,
-			this);
+			this,
+			i);
 	}
 
 	Logger::Verbose() << "ThreadPool created. Threads: " << threadCount;
@@ -115,8 +122,105 @@ void ThreadPool::WaitAll()
 	}
 }
 
-void ThreadPool::ThreadFunction()
+void ThreadPool::ParallelFor(
+	size_t count,
+	size_t chunkSize,
+	std::function<void(size_t, size_t)> action)
 {
+	if (chunkSize == 0) {
+		chunkSize = 1;
+	}
+
+	size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+	if (chunkCount <= 1 || _threads.empty()) {
+		if (count > 0) {
+			action(0, count);
+		}
+
+		return;
+	}
+
+	// Helper tasks may start after the call has returned, so they
+	// only share reference counted state.
+	struct State
+	{
+		std::atomic<size_t> NextChunk;
+		size_t ChunkCount;
+		size_t ChunkSize;
+		size_t Count;
+		std::function<void(size_t, size_t)> Action;
+		Sync::Semaphore Done;
+	};
+
+	auto state = std::make_shared<State>();
+	state->NextChunk = 0;
+	state->ChunkCount = chunkCount;
+	state->ChunkSize = chunkSize;
+	state->Count = count;
+	state->Action = action;
+
+	auto work = [](State* state) -> size_t
+	{
+		size_t processed = 0;
+
+		while (true) {
+			size_t chunk = state->NextChunk++;
+
+			if (chunk >= state->ChunkCount) {
+				break;
+			}
+
+			size_t begin = chunk * state->ChunkSize;
+			size_t end = std::min(
+				begin + state->ChunkSize,
+				state->Count);
+
+			state->Action(begin, end);
+			++processed;
+		}
+
+		return processed;
+	};
+
+	size_t helperCount = std::min<size_t>(
+		_threads.size(),
+		chunkCount - 1);
+
+	for (size_t i = 0; i < helperCount; ++i) {
+		Enqueue(
+			[state, work]() -> void
+			{
+				size_t processed = work(state.get());
+
+				for (size_t i = 0; i < processed; ++i) {
+					state->Done.Up();
+				}
+			},
+			false);
+	}
+
+	size_t processed = work(state.get());
+
+	for (size_t i = processed; i < chunkCount; ++i) {
+		state->Done.Down();
+	}
+}
+
+uint32_t ThreadPool::GetWorkerIndex() const
+{
+	if (currentPool == this) {
+		return currentWorkerIndex;
+	}
+
+	return _threads.size();
+}
+
+void ThreadPool::ThreadFunction(uint32_t index)
+{
+	currentPool = this;
+	currentWorkerIndex = index;
+
 	while (true) {
 		_queueSemaphore.Down();
 
@@ -20,6 +20,24 @@ public:
 	void Wait(uint32_t id);
 	void WaitAll();
 
+	// Splits [0, count) into chunks and runs action(begin, end) on
+	// them in parallel. The calling thread takes part in the work and
+	// only waits for chunks already taken by workers, so it is safe to
+	// call from inside a pool task.
+	void ParallelFor(
+		size_t count,
+		size_t chunkSize,
+		std::function<void(size_t, size_t)> action);
+
+	uint32_t GetThreadCount() const
+	{
+		return _threads.size();
+	}
+
+	// Index of the pool thread calling this in [0, GetThreadCount()),
+	// GetThreadCount() for threads that do not belong to the pool.
+	uint32_t GetWorkerIndex() const;
+
 private:
 	struct Task
 	{
@@ -39,7 +57,7 @@ private:
 	uint32_t _lastId;
 
 	volatile bool _work;
-	void ThreadFunction();
+	void ThreadFunction(uint32_t index);
 
 	void StartThreads(uint32_t threadCount);
 };